@@ -31,77 +31,1618 @@ SOFTWARE.
 #include <assert.h>
 #include <math.h>
 
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifndef AM_FFT_NO_FILES
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
 #ifndef AM_FFT_ALLOC
 #include <stdlib.h>
 #define AM_FFT_ALLOC malloc
 #define AM_FFT_FREE free
 #endif
 
-#ifndef AM_FFT_NO_SSE2
-#include <emmintrin.h>
+#ifdef AM_FFT_NO_SSE2
+#define AM_FFT_NO_AVX2
+#endif
+
+#ifndef AM_FFT_NO_AVX2
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AM_FFT_TARGET_AVX2
+#define AM_FFT_TARGET_AVX512
+#else
+#include <cpuid.h>
+#define AM_FFT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define AM_FFT_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#else
+#define AM_FFT_NO_AVX2
+#endif
+#endif
+
+#ifdef AM_FFT_NO_AVX2
+#define AM_FFT_NO_AVX512
+#endif
+
+#ifndef AM_FFT_NO_SSE2
+#include <emmintrin.h>
+#endif
+
+// Instruction sets of the butterfly passes, picked per plan from cpuid:
+#define AM_FFT_SIMD_SSE2 0
+#define AM_FFT_SIMD_AVX2 1
+#define AM_FFT_SIMD_AVX512 2
+
+// Engines: bit reversal followed by radix-2 passes, or stockham autosort radix-4/8 stages ping-ponging between out and a scratch buffer:
+#define AM_FFT_ENGINE_RADIX2 0
+#define AM_FFT_ENGINE_STOCKHAM 1
+#define AM_FFT_ENGINE_REAL 2 // Real-to-complex and complex-to-real plans wrapping a half-length complex plan
+#define AM_FFT_ENGINE_FOUR_STEP 3 // Long sizes n = n1 * n2 as n1-point column dfts, twiddles, n2-point row dfts and a transpose
+
+// Largest 2D grid (exclusive) whose columns are transformed in strips instead of after a transpose, unless wisdom says otherwise:
+#ifndef AM_FFT_COLUMNS_MAX_CELLS
+#define AM_FFT_COLUMNS_MAX_CELLS (1024 * 1024)
+#endif
+
+// Smallest size planned with the stockham engine:
+#ifndef AM_FFT_STOCKHAM_MIN_N
+#define AM_FFT_STOCKHAM_MIN_N 16
+#endif
+
+// Smallest size planned with the four-step engine without wisdom (none by default, it only pays off once the stockham
+// stages of a size fall out of the last level cache), and the smallest one AM_FFT_MEASURE tries it on:
+#ifndef AM_FFT_FOUR_STEP_MIN_N
+#define AM_FFT_FOUR_STEP_MIN_N 0xffffffffu
+#endif
+#ifndef AM_FFT_FOUR_STEP_MEASURE_MIN_N
+#define AM_FFT_FOUR_STEP_MEASURE_MIN_N 4096
+#endif
+
+// AM_FFT_MEASURE times each candidate AM_FFT_MEASURE_RUNS times on about AM_FFT_MEASURE_WORK complex values and keeps the best run:
+#ifndef AM_FFT_MEASURE_WORK
+#define AM_FFT_MEASURE_WORK (1 << 16)
+#endif
+#ifndef AM_FFT_MEASURE_RUNS
+#define AM_FFT_MEASURE_RUNS 5
+#endif
+#define AM_FFT_WISDOM_VERSION 2
+
+// Alignment of the radix-2 pass twiddles, enough for aligned AVX-512 loads:
+#define AM_FFT_TWIDDLE_ALIGN 64
+
+// Twiddles of one size and direction, shared by every plan that needs them and freed with the last one:
+typedef struct am_fft_tables_
+{
+	float *pass_twiddles;     // Radix-2 passes from half = 4 up, each with (cos, cos) pairs then (sin, -sin) pairs of its butterflies
+	unsigned int *twiddle_table;
+	float *stockham_twiddles; // W^(k * p) of every stockham stage, interleaved and ordered by k then p
+	float *four_step_twiddles; // W^(j2 * k1) of the four-step engine, interleaved and ordered by j2 then k1
+	unsigned int n;
+	int direction;
+	int engine;
+	unsigned int refs;
+	struct am_fft_tables_ *next;
+} am_fft_tables_t;
+
+// Unrolled stockham kernel of one size:
+typedef void (*am_fft_stockham_fixed_t)(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch);
+
+struct am_fft_plan_1d_
+{
+	am_fft_tables_t *tables; // The pointers below point into the shared tables
+	float *pass_twiddles;
+	unsigned int *twiddle_table;
+	float *stockham_twiddles;
+	float *four_step_twiddles;
+	am_fft_complex_t *scratch; // 0 for plans made with AM_FFT_NO_SCRATCH
+	am_fft_plan_1d_t *four_step[2]; // Four-step plans only, the n1-point column and n2-point row dfts
+	am_fft_stockham_fixed_t fixed;  // Stockham plans of the sizes with an unrolled kernel, see am_fft_stockham_fixed_find
+	am_fft_plan_1d_t *half; // Real plans only, with the W^k table of the twiddle pass
+	float *real_cos_table;
+	float *real_sin_table;
+	unsigned int n;
+	int direction;
+	int simd;
+	int engine;
+};
+
+struct am_fft_plan_2d_
+{
+	am_fft_plan_1d_t *x;
+	am_fft_plan_1d_t *y;
+	am_fft_complex_t *tmp;     // 0 for plans made with AM_FFT_NO_SCRATCH
+	am_fft_complex_t *scratch; // Serial passes
+	unsigned int width;
+	unsigned int height;
+	int columns;               // Second dimension in column strips rather than between transposes
+};
+
+// Measured choice for a 1D size (dimensions 1, height 1: engine and instruction set) or a complex 2D grid (dimensions 2,
+// engine 1 for column strips). A width x 1 grid and the 1D size width are separate entries:
+typedef struct am_fft_wisdom_
+{
+	int dimensions;
+	unsigned int width;
+	unsigned int height;
+	int engine;
+	int simd;
+	struct am_fft_wisdom_ *next;
+} am_fft_wisdom_t;
+
+#ifndef AM_FFT_NO_AVX2
+static void am_fft_cpuid(int leaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, leaf, 0);
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long am_fft_xgetbv()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+static int am_fft_detect_simd()
+{
+	int simd = AM_FFT_SIMD_SSE2;
+#ifndef AM_FFT_NO_AVX2
+	unsigned int regs[4];
+	am_fft_cpuid(0, regs);
+	unsigned int max_leaf = regs[0];
+	am_fft_cpuid(1, regs);
+	int fma = (regs[2] >> 12) & 1;
+	int osxsave = (regs[2] >> 27) & 1;
+	if (max_leaf < 7 || !fma || !osxsave)
+		return simd;
+
+	// The OS has to save the ymm (and for AVX-512 the opmask and zmm) state:
+	unsigned long long xcr0 = am_fft_xgetbv();
+	am_fft_cpuid(7, regs);
+	if ((regs[1] >> 5) & 1 && (xcr0 & 0x6) == 0x6)
+		simd = AM_FFT_SIMD_AVX2;
+#ifndef AM_FFT_NO_AVX512
+	if (simd == AM_FFT_SIMD_AVX2 && (regs[1] >> 16) & 1 && (xcr0 & 0xe6) == 0xe6)
+		simd = AM_FFT_SIMD_AVX512;
+#endif
+#endif
+	return simd;
+}
+
+static int am_fft_simd()
+{
+	static int simd = am_fft_detect_simd();
+	return simd;
+}
+
+#define AM_FFT_MAX_STAGES 32
+
+// Splits n = 2^a * 3^b * 5^c into radix-4 and radix-8 stages (or a single radix-2 stage when a == 1) followed by
+// radix-3 and radix-5 stages. Returns 0 for any other n:
+static unsigned int am_fft_stockham_radices(unsigned int n, unsigned int *radices)
+{
+	unsigned int levels = 0;
+	for (; n > 1 && (n & 1) == 0; n >>= 1)
+		levels++;
+	unsigned int count = 0;
+	if (levels == 1)
+	{
+		radices[count++] = 2;
+	}
+	else
+	{
+		unsigned int fours = levels % 3 == 1 ? 2 : levels % 3 == 2 ? 1 : 0;
+		for (unsigned int i = 0; i < fours; i++)
+			radices[count++] = 4;
+		for (unsigned int i = 0; i < (levels - 2 * fours) / 3; i++)
+			radices[count++] = 8;
+	}
+	for (; n % 3 == 0; n /= 3)
+		radices[count++] = 3;
+	for (; n % 5 == 0; n /= 5)
+		radices[count++] = 5;
+	return n == 1 ? count : 0;
+}
+
+// Splits n into n1 * n2 with n1 <= n2 as close to sqrt(n) as possible, returns 0 for primes:
+static unsigned int am_fft_four_step_split(unsigned int n)
+{
+	unsigned int n1 = 0;
+	for (unsigned int d = 2; d * d <= n; d++)
+	{
+		if (n % d == 0)
+			n1 = d;
+	}
+	return n1;
+}
+
+// Powers of two below the threshold run the radix-2 passes, everything else the stockham stages:
+static int am_fft_small_engine(unsigned int n)
+{
+	return (n & (n - 1)) == 0 && n < AM_FFT_STOCKHAM_MIN_N ? AM_FFT_ENGINE_RADIX2 : AM_FFT_ENGINE_STOCKHAM;
+}
+
+// Long sizes split into the four-step engine:
+static int am_fft_default_engine(unsigned int n)
+{
+	if (n >= AM_FFT_FOUR_STEP_MIN_N && am_fft_four_step_split(n))
+		return AM_FFT_ENGINE_FOUR_STEP;
+	return am_fft_small_engine(n);
+}
+
+static am_fft_tables_t* am_fft_tables_create(int direction, unsigned int n, int engine)
+{
+	unsigned int levels = 0;
+	for (unsigned int temp = n; temp > 1; temp >>= 1)
+		levels++;
+	if (engine == AM_FFT_ENGINE_RADIX2 && (n & (n - 1)) != 0)
+		return 0;
+
+	unsigned int radices[AM_FFT_MAX_STAGES];
+	unsigned int stages = engine == AM_FFT_ENGINE_STOCKHAM ? am_fft_stockham_radices(n, radices) : 0;
+	if (engine == AM_FFT_ENGINE_STOCKHAM && stages == 0)
+		return 0;
+	unsigned int stockham_twiddle_count = 0;
+	for (unsigned int i = 0, length = n; i < stages; length /= radices[i], i++)
+		stockham_twiddle_count += (radices[i] - 1) * (length / radices[i]);
+	unsigned int four_step_twiddle_count = engine == AM_FFT_ENGINE_FOUR_STEP ? n : 0;
+	unsigned int n1 = engine == AM_FFT_ENGINE_FOUR_STEP ? am_fft_four_step_split(n) : 0;
+	if (engine == AM_FFT_ENGINE_FOUR_STEP && n1 == 0)
+		return 0;
+	unsigned int pass_twiddle_count = 0;
+	unsigned int twiddle_table_count = engine == AM_FFT_ENGINE_RADIX2 ? n : 0;
+	for (unsigned int half = 4; half < twiddle_table_count; half <<= 1)
+		pass_twiddle_count += 4 * half;
+
+	void *mem = AM_FFT_ALLOC(sizeof(am_fft_tables_t) + AM_FFT_TWIDDLE_ALIGN + pass_twiddle_count * sizeof(float) +
+		twiddle_table_count * sizeof(unsigned int) + (stockham_twiddle_count + four_step_twiddle_count) * sizeof(am_fft_complex_t));
+	am_fft_tables_t *plan = (am_fft_tables_t*)mem;
+	size_t aligned = ((size_t)(plan + 1) + AM_FFT_TWIDDLE_ALIGN - 1) & ~(size_t)(AM_FFT_TWIDDLE_ALIGN - 1);
+	plan->pass_twiddles = (float*)aligned;
+	plan->twiddle_table = (unsigned int*)(plan->pass_twiddles + pass_twiddle_count);
+	plan->stockham_twiddles = 0;
+	plan->four_step_twiddles = 0;
+	plan->n = n;
+	plan->direction = direction;
+	plan->engine = engine;
+	plan->refs = 1;
+	plan->next = 0;
+	
+	for (unsigned int i = 0; i < twiddle_table_count; i++)
+	{
+		unsigned int j = 0;
+		unsigned int bits = i;
+		for (unsigned int l = 0; l < levels; l++, bits >>= 1)
+			j = (j << 1) | (bits & 1);
+		plan->twiddle_table[i] = j;
+	}
+	
+	// Butterfly k of a pass multiplies by e^(-+2*pi*i*k/(2 * half)), laid out in the order the pass loops consume it:
+	const double pi = 3.14159265358979323846; // Don't rely on M_PI being defined
+	float *pass_twiddles = plan->pass_twiddles;
+	for (unsigned int half = 4; half < twiddle_table_count; pass_twiddles += 4 * half, half <<= 1)
+	{
+		const double angle_step = pi / (double)half * (direction == AM_FFT_FORWARD ? 1.0 : -1.0);
+		for (unsigned int k = 0; k < half; k++)
+		{
+			double angle = (double)k * angle_step;
+			pass_twiddles[2 * k + 0] = (float)cos(angle);
+			pass_twiddles[2 * k + 1] = (float)cos(angle);
+			pass_twiddles[2 * half + 2 * k + 0] = (float)sin(angle);
+			pass_twiddles[2 * half + 2 * k + 1] = -(float)sin(angle);
+		}
+	}
+
+	if (engine == AM_FFT_ENGINE_STOCKHAM)
+	{
+		plan->stockham_twiddles = (float*)(plan->twiddle_table + twiddle_table_count);
+		float *twiddles = plan->stockham_twiddles;
+		for (unsigned int i = 0, length = n; i < stages; length /= radices[i], i++)
+		{
+			unsigned int m = length / radices[i];
+			const double stage_step = 2.0 * pi / (double)length * (direction == AM_FFT_FORWARD ? -1.0 : 1.0);
+			for (unsigned int k = 1; k < radices[i]; k++)
+			{
+				for (unsigned int p = 0; p < m; p++, twiddles += 2)
+				{
+					double angle = stage_step * (double)(k * p);
+					twiddles[0] = (float)cos(angle);
+					twiddles[1] = (float)sin(angle);
+				}
+			}
+		}
+	}
+	
+	if (engine == AM_FFT_ENGINE_FOUR_STEP)
+	{
+		unsigned int n2 = n / n1;
+		plan->four_step_twiddles = (float*)(plan->twiddle_table + twiddle_table_count);
+		const double angle_step = 2.0 * pi / (double)n * (direction == AM_FFT_FORWARD ? -1.0 : 1.0);
+		for (unsigned int j2 = 0; j2 < n2; j2++)
+		{
+			for (unsigned int k1 = 0; k1 < n1; k1++)
+			{
+				double angle = angle_step * (double)(j2 * k1);
+				plan->four_step_twiddles[2 * (j2 * n1 + k1) + 0] = (float)cos(angle);
+				plan->four_step_twiddles[2 * (j2 * n1 + k1) + 1] = (float)sin(angle);
+			}
+		}
+	}
+	
+	return plan;
+}
+
+static std::mutex am_fft_tables_mutex;
+static am_fft_tables_t *am_fft_tables_list = 0;
+
+static am_fft_tables_t* am_fft_tables_acquire(int direction, unsigned int n, int engine)
+{
+	std::lock_guard<std::mutex> lock(am_fft_tables_mutex);
+	for (am_fft_tables_t *tables = am_fft_tables_list; tables; tables = tables->next)
+	{
+		if (tables->n == n && tables->direction == direction && tables->engine == engine)
+		{
+			tables->refs++;
+			return tables;
+		}
+	}
+	am_fft_tables_t *tables = am_fft_tables_create(direction, n, engine);
+	if (tables)
+	{
+		tables->next = am_fft_tables_list;
+		am_fft_tables_list = tables;
+	}
+	return tables;
+}
+
+static void am_fft_tables_release(am_fft_tables_t *tables)
+{
+	std::lock_guard<std::mutex> lock(am_fft_tables_mutex);
+	if (--tables->refs > 0)
+		return;
+	am_fft_tables_t **link = &am_fft_tables_list;
+	while (*link != tables)
+		link = &(*link)->next;
+	*link = tables->next;
+	AM_FFT_FREE(tables);
+}
+
+static am_fft_stockham_fixed_t am_fft_stockham_fixed_find(unsigned int n);
+
+static am_fft_plan_1d_t* am_fft_plan_1d_make(int direction, unsigned int n, int engine, int simd, int flags)
+{
+	am_fft_tables_t *tables = am_fft_tables_acquire(direction, n, engine);
+	if (!tables)
+		return 0;
+
+	unsigned int scratch_count = engine != AM_FFT_ENGINE_RADIX2 && !flags ? n : 0;
+	void *mem = AM_FFT_ALLOC(sizeof(am_fft_plan_1d_t) + scratch_count * sizeof(am_fft_complex_t));
+	am_fft_plan_1d_t *plan = (am_fft_plan_1d_t*)mem;
+	plan->tables = tables;
+	plan->pass_twiddles = tables->pass_twiddles;
+	plan->twiddle_table = tables->twiddle_table;
+	plan->stockham_twiddles = tables->stockham_twiddles;
+	plan->four_step_twiddles = tables->four_step_twiddles;
+	plan->scratch = scratch_count ? (am_fft_complex_t*)(plan + 1) : 0;
+	plan->four_step[0] = 0;
+	plan->four_step[1] = 0;
+	plan->fixed = engine == AM_FFT_ENGINE_STOCKHAM ? am_fft_stockham_fixed_find(n) : 0;
+	plan->half = 0;
+	plan->real_cos_table = 0;
+	plan->real_sin_table = 0;
+	plan->n = n;
+	plan->direction = direction;
+	plan->simd = simd < am_fft_simd() ? simd : am_fft_simd(); // Wisdom may come from another machine
+	plan->engine = engine;
+
+	// The sub-dfts of the four-step engine work in the scratch of this plan and never split again:
+	if (engine == AM_FFT_ENGINE_FOUR_STEP)
+	{
+		unsigned int n1 = am_fft_four_step_split(n);
+		plan->four_step[0] = am_fft_plan_1d_make(direction, n1, am_fft_small_engine(n1), simd, AM_FFT_NO_SCRATCH);
+		plan->four_step[1] = am_fft_plan_1d_make(direction, n / n1, am_fft_small_engine(n / n1), simd, AM_FFT_NO_SCRATCH);
+		if (!plan->four_step[0] || !plan->four_step[1])
+		{
+			am_fft_plan_1d_free(plan);
+			return 0;
+		}
+	}
+	return plan;
+}
+
+static std::mutex am_fft_wisdom_mutex;
+static am_fft_wisdom_t *am_fft_wisdom_list = 0;
+
+static int am_fft_wisdom_find(int dimensions, unsigned int width, unsigned int height, am_fft_wisdom_t *wisdom)
+{
+	std::lock_guard<std::mutex> lock(am_fft_wisdom_mutex);
+	for (am_fft_wisdom_t *entry = am_fft_wisdom_list; entry; entry = entry->next)
+	{
+		if (entry->dimensions == dimensions && entry->width == width && entry->height == height)
+		{
+			*wisdom = *entry;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void am_fft_wisdom_record(const am_fft_wisdom_t *wisdom)
+{
+	std::lock_guard<std::mutex> lock(am_fft_wisdom_mutex);
+	am_fft_wisdom_t *entry = am_fft_wisdom_list;
+	while (entry && (entry->dimensions != wisdom->dimensions || entry->width != wisdom->width || entry->height != wisdom->height))
+		entry = entry->next;
+	if (!entry)
+	{
+		entry = (am_fft_wisdom_t*)AM_FFT_ALLOC(sizeof(am_fft_wisdom_t));
+		entry->next = am_fft_wisdom_list;
+		am_fft_wisdom_list = entry;
+	}
+	entry->dimensions = wisdom->dimensions;
+	entry->width = wisdom->width;
+	entry->height = wisdom->height;
+	entry->engine = wisdom->engine;
+	entry->simd = wisdom->simd;
+}
+
+static double am_fft_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Times every engine and instruction set that can run n-point dfts on this cpu:
+static int am_fft_measure_1d(unsigned int n, am_fft_wisdom_t *wisdom)
+{
+	am_fft_complex_t *buffers = (am_fft_complex_t*)AM_FFT_ALLOC(3 * n * sizeof(am_fft_complex_t));
+	for (unsigned int i = 0; i < 3 * n; i++)
+	{
+		buffers[i][0] = (float)(i % 7) - 3.0f;
+		buffers[i][1] = (float)(i % 5) - 2.0f;
+	}
+	unsigned int repeats = n < AM_FFT_MEASURE_WORK ? AM_FFT_MEASURE_WORK / n : 1;
+	double best = -1.0;
+	const int engines[] = { AM_FFT_ENGINE_RADIX2, AM_FFT_ENGINE_STOCKHAM, AM_FFT_ENGINE_FOUR_STEP };
+	for (int engine : engines)
+	{
+		if (engine == AM_FFT_ENGINE_FOUR_STEP && n < AM_FFT_FOUR_STEP_MEASURE_MIN_N)
+			continue;
+		// The sub-dfts of four-step plans pick their own instruction set:
+		for (int simd = engine == AM_FFT_ENGINE_FOUR_STEP ? am_fft_simd() : AM_FFT_SIMD_SSE2; simd <= am_fft_simd(); simd++)
+		{
+			am_fft_plan_1d_t *plan = am_fft_plan_1d_make(AM_FFT_FORWARD, n, engine, simd, AM_FFT_NO_SCRATCH);
+			if (!plan)
+				continue;
+			for (int run = 0; run < AM_FFT_MEASURE_RUNS; run++)
+			{
+				double start = am_fft_seconds();
+				for (unsigned int i = 0; i < repeats; i++)
+					am_fft_1d_scratch(plan, buffers, buffers + n, buffers + 2 * n);
+				double seconds = am_fft_seconds() - start;
+				if (best < 0.0 || seconds < best)
+				{
+					best = seconds;
+					wisdom->engine = engine;
+					wisdom->simd = simd;
+				}
+			}
+			am_fft_plan_1d_free(plan);
+		}
+	}
+	AM_FFT_FREE(buffers);
+	return best >= 0.0;
+}
+
+am_fft_plan_1d_t* am_fft_plan_1d(int direction, unsigned int n)
+{
+	int flags = direction & (AM_FFT_NO_SCRATCH | AM_FFT_MEASURE);
+	direction &= ~(AM_FFT_NO_SCRATCH | AM_FFT_MEASURE);
+	if (n == 0)
+		return 0;
+
+	am_fft_wisdom_t wisdom = { 1, n, 1, am_fft_default_engine(n), am_fft_simd(), 0 };
+	int wise = am_fft_wisdom_find(1, n, 1, &wisdom);
+	if (!wise && (flags & AM_FFT_MEASURE) && am_fft_measure_1d(n, &wisdom))
+	{
+		am_fft_wisdom_record(&wisdom);
+		wise = 1;
+	}
+	if (wise)
+	{
+		am_fft_plan_1d_t *plan = am_fft_plan_1d_make(direction, n, wisdom.engine, wisdom.simd, flags & AM_FFT_NO_SCRATCH);
+		if (plan)
+			return plan;
+	}
+	return am_fft_plan_1d_make(direction, n, am_fft_default_engine(n), am_fft_simd(), flags & AM_FFT_NO_SCRATCH);
+}
+
+// An n-point real dft is computed by an (n / 2)-point complex dft of z[j] = x[2j] + i * x[2j + 1] plus a twiddle pass over W^k = e^(-+2*pi*i*k/n):
+static am_fft_plan_1d_t* am_fft_plan_1d_real(int direction, unsigned int n)
+{
+	int flags = direction & (AM_FFT_NO_SCRATCH | AM_FFT_MEASURE);
+	direction &= ~(AM_FFT_NO_SCRATCH | AM_FFT_MEASURE);
+	if (n < 2 || (n & 1))
+		return 0;
+	unsigned int half = n / 2;
+	am_fft_plan_1d_t *half_plan = am_fft_plan_1d(direction | flags, half);
+	if (!half_plan)
+		return 0;
+
+	unsigned int scratch_count = flags & AM_FFT_NO_SCRATCH ? 0 : half;
+	void *mem = AM_FFT_ALLOC(sizeof(am_fft_plan_1d_t) + 2 * half * sizeof(float) + scratch_count * sizeof(am_fft_complex_t));
+	am_fft_plan_1d_t *plan = (am_fft_plan_1d_t*)mem;
+	plan->tables = 0;
+	plan->twiddle_table = 0;
+	plan->pass_twiddles = 0;
+	plan->stockham_twiddles = 0;
+	plan->four_step_twiddles = 0;
+	plan->four_step[0] = 0;
+	plan->four_step[1] = 0;
+	plan->fixed = 0;
+	plan->half = half_plan;
+	plan->real_cos_table = (float*)(plan + 1);
+	plan->real_sin_table = plan->real_cos_table + half;
+	plan->scratch = scratch_count ? (am_fft_complex_t*)(plan->real_sin_table + half) : 0; // z of the complex-to-real direction
+	plan->n = n;
+	plan->direction = direction;
+	plan->simd = half_plan->simd;
+	plan->engine = AM_FFT_ENGINE_REAL;
+
+	const double pi = 3.14159265358979323846;
+	const double angle_step = 2.0 * pi / (double)n * (direction == AM_FFT_FORWARD ? -1.0 : 1.0);
+	for (unsigned int i = 0; i < half; i++)
+	{
+		double angle = (double)i * angle_step;
+		plan->real_cos_table[i] = (float)cos(angle);
+		plan->real_sin_table[i] = (float)sin(angle);
+	}
+	return plan;
+}
+
+am_fft_plan_1d_t* am_fft_plan_1d_r2c(int direction, unsigned int n)
+{
+	return am_fft_plan_1d_real(direction, n);
+}
+
+am_fft_plan_1d_t* am_fft_plan_1d_c2r(int direction, unsigned int n)
+{
+	return am_fft_plan_1d_real(direction, n);
+}
+
+void am_fft_plan_1d_free(am_fft_plan_1d_t *plan)
+{
+	if (plan->half)
+		am_fft_plan_1d_free(plan->half);
+	if (plan->four_step[0])
+		am_fft_plan_1d_free(plan->four_step[0]);
+	if (plan->four_step[1])
+		am_fft_plan_1d_free(plan->four_step[1]);
+	if (plan->tables)
+		am_fft_tables_release(plan->tables);
+	AM_FFT_FREE(plan);
+}
+
+// One radix-2 pass combining blocks of 2 * half values. twiddles holds the (cos, cos) pairs of the half butterflies of a block,
+// followed by their (sin, -sin) pairs, so every kernel below just loads the next vector:
+static void am_fft_pass(am_fft_complex_t *out, unsigned int n, unsigned int half, const float *twiddles)
+{
+	unsigned int size = half << 1;
+	const float *cos_pairs = twiddles;
+	const float *sin_pairs = twiddles + 2 * half;
+	for (unsigned int i = 0; i < n; i += size)
+	{
+		#ifdef AM_FFT_NO_SSE2
+		for (unsigned int j = i, k = 0; j < i + half; j++, k++)
+		{
+			unsigned int l = j + half;
+			float ar = out[l][0] * cos_pairs[2 * k] + out[l][1] * sin_pairs[2 * k];
+			float ai = out[l][1] * cos_pairs[2 * k] + out[l][0] * sin_pairs[2 * k + 1];
+			out[l][0] = out[j][0] - ar;
+			out[l][1] = out[j][1] - ai;
+			out[j][0] = out[j][0] + ar;
+			out[j][1] = out[j][1] + ai;
+		}
+		#else
+		for (unsigned int j = i, k = 0; j < i + half; j += 2, k += 2)
+		{
+			unsigned int l = j + half;
+			
+			__m128 aribri = _mm_loadu_ps(&out[l][0]);
+			__m128 cridri = _mm_loadu_ps(&out[j][0]);
+			
+			__m128 airbir = _mm_shuffle_ps(aribri, aribri, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 cos0011 = _mm_load_ps(cos_pairs + 2 * k);
+			__m128 sin0011 = _mm_load_ps(sin_pairs + 2 * k);
+			__m128 aribri2 = _mm_add_ps(_mm_mul_ps(aribri, cos0011), _mm_mul_ps(airbir, sin0011));
+			
+			_mm_storeu_ps(&out[l][0], _mm_sub_ps(cridri, aribri2));
+			_mm_storeu_ps(&out[j][0], _mm_add_ps(cridri, aribri2));
+		}
+		#endif
+	}
+}
+
+#ifndef AM_FFT_NO_AVX2
+// Same pass on 4 butterflies at once, needs half >= 4:
+AM_FFT_TARGET_AVX2 static void am_fft_pass_avx2(am_fft_complex_t *out, unsigned int n, unsigned int half, const float *twiddles)
+{
+	unsigned int size = half << 1;
+	const float *cos_pairs = twiddles;
+	const float *sin_pairs = twiddles + 2 * half;
+	for (unsigned int i = 0; i < n; i += size)
+	{
+		for (unsigned int j = i, k = 0; j < i + half; j += 4, k += 4)
+		{
+			unsigned int l = j + half;
+			__m256 cos = _mm256_load_ps(cos_pairs + 2 * k);
+			__m256 sin = _mm256_load_ps(sin_pairs + 2 * k);
+
+			__m256 a = _mm256_loadu_ps(&out[l][0]);
+			__m256 c = _mm256_loadu_ps(&out[j][0]);
+			__m256 a_swapped = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+			__m256 a2 = _mm256_fmadd_ps(a, cos, _mm256_mul_ps(a_swapped, sin));
+
+			_mm256_storeu_ps(&out[l][0], _mm256_sub_ps(c, a2));
+			_mm256_storeu_ps(&out[j][0], _mm256_add_ps(c, a2));
+		}
+	}
+}
+#endif
+
+#ifndef AM_FFT_NO_AVX512
+// 8 butterflies at once, needs half >= 8:
+AM_FFT_TARGET_AVX512 static void am_fft_pass_avx512(am_fft_complex_t *out, unsigned int n, unsigned int half, const float *twiddles)
+{
+	unsigned int size = half << 1;
+	const float *cos_pairs = twiddles;
+	const float *sin_pairs = twiddles + 2 * half;
+	for (unsigned int i = 0; i < n; i += size)
+	{
+		for (unsigned int j = i, k = 0; j < i + half; j += 8, k += 8)
+		{
+			unsigned int l = j + half;
+			__m512 cos = _mm512_load_ps(cos_pairs + 2 * k);
+			__m512 sin = _mm512_load_ps(sin_pairs + 2 * k);
+
+			__m512 a = _mm512_loadu_ps(&out[l][0]);
+			__m512 c = _mm512_loadu_ps(&out[j][0]);
+			__m512 a_swapped = _mm512_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+			__m512 a2 = _mm512_fmadd_ps(a, cos, _mm512_mul_ps(a_swapped, sin));
+
+			_mm512_storeu_ps(&out[l][0], _mm512_sub_ps(c, a2));
+			_mm512_storeu_ps(&out[j][0], _mm512_add_ps(c, a2));
+		}
+	}
+}
+#endif
+
+// Stockham stages. A stage of radix r over sub-transforms of length r * m with stride s reads
+// x[q + s * (p + t * m)] for t < r and writes the twiddled r-point dft to y[q + s * (r * p + k)], with p < m and q < s.
+// j is the rotation by i (forward) or -i (inverse), the radix-4 dft is then (a + c) +- (b + d) and (a - c) -+ j * (b - d).
+#define AM_FFT_SQRT_HALF 0.70710678118654752f
+#define AM_FFT_SIN_60 0.86602540378443865f
+#define AM_FFT_COS_72 0.30901699437494742f
+#define AM_FFT_COS_144 -0.80901699437494742f
+#define AM_FFT_SIN_72 0.95105651629515357f
+#define AM_FFT_SIN_144 0.58778525229247313f
+
+static inline void am_fft_cmul(float *a, const float *w)
+{
+	float re = a[0] * w[0] - a[1] * w[1];
+	float im = a[0] * w[1] + a[1] * w[0];
+	a[0] = re;
+	a[1] = im;
+}
+
+static void am_fft_radix2(float (*v)[2])
+{
+	float d[2] = { v[0][0] - v[1][0], v[0][1] - v[1][1] };
+	v[0][0] += v[1][0]; v[0][1] += v[1][1];
+	v[1][0] = d[0]; v[1][1] = d[1];
+}
+
+// X1 and X2 are a - (b + c) / 2 -+ j * sin(60) * (b - c):
+static void am_fft_radix3(float (*v)[2], float j)
+{
+	float t1[2] = { v[1][0] + v[2][0], v[1][1] + v[2][1] };
+	float t2[2] = { v[0][0] - 0.5f * t1[0], v[0][1] - 0.5f * t1[1] };
+	float jt3[2] = { -j * AM_FFT_SIN_60 * (v[1][1] - v[2][1]), j * AM_FFT_SIN_60 * (v[1][0] - v[2][0]) };
+	v[0][0] += t1[0]; v[0][1] += t1[1];
+	v[1][0] = t2[0] - jt3[0]; v[1][1] = t2[1] - jt3[1];
+	v[2][0] = t2[0] + jt3[0]; v[2][1] = t2[1] + jt3[1];
+}
+
+// X1 and X4 are a + cos(72) * (b + e) + cos(144) * (c + d) -+ j * (sin(72) * (b - e) + sin(144) * (c - d)),
+// X2 and X3 swap the cosines and use sin(144) * (b - e) - sin(72) * (c - d):
+static void am_fft_radix5(float (*v)[2], float j)
+{
+	float s1[2], s2[2], d1[2], d2[2];
+	for (unsigned int c = 0; c < 2; c++)
+	{
+		s1[c] = v[1][c] + v[4][c];
+		s2[c] = v[2][c] + v[3][c];
+		d1[c] = v[1][c] - v[4][c];
+		d2[c] = v[2][c] - v[3][c];
+	}
+	float a1[2], a2[2], b1[2], b2[2];
+	for (unsigned int c = 0; c < 2; c++)
+	{
+		a1[c] = v[0][c] + AM_FFT_COS_72 * s1[c] + AM_FFT_COS_144 * s2[c];
+		a2[c] = v[0][c] + AM_FFT_COS_144 * s1[c] + AM_FFT_COS_72 * s2[c];
+		b1[c] = AM_FFT_SIN_72 * d1[c] + AM_FFT_SIN_144 * d2[c];
+		b2[c] = AM_FFT_SIN_144 * d1[c] - AM_FFT_SIN_72 * d2[c];
+	}
+	float jb1[2] = { -j * b1[1], j * b1[0] };
+	float jb2[2] = { -j * b2[1], j * b2[0] };
+	for (unsigned int c = 0; c < 2; c++)
+	{
+		v[0][c] += s1[c] + s2[c];
+		v[1][c] = a1[c] - jb1[c];
+		v[4][c] = a1[c] + jb1[c];
+		v[2][c] = a2[c] - jb2[c];
+		v[3][c] = a2[c] + jb2[c];
+	}
+}
+
+static void am_fft_radix4(float (*v)[2], float j)
+{
+	float apc[2] = { v[0][0] + v[2][0], v[0][1] + v[2][1] };
+	float amc[2] = { v[0][0] - v[2][0], v[0][1] - v[2][1] };
+	float bpd[2] = { v[1][0] + v[3][0], v[1][1] + v[3][1] };
+	float jbmd[2] = { -j * (v[1][1] - v[3][1]), j * (v[1][0] - v[3][0]) };
+	v[0][0] = apc[0] + bpd[0]; v[0][1] = apc[1] + bpd[1];
+	v[1][0] = amc[0] - jbmd[0]; v[1][1] = amc[1] - jbmd[1];
+	v[2][0] = apc[0] - bpd[0]; v[2][1] = apc[1] - bpd[1];
+	v[3][0] = amc[0] + jbmd[0]; v[3][1] = amc[1] + jbmd[1];
+}
+
+static void am_fft_radix8(float (*v)[2], float j)
+{
+	const float w8_1[2] = { AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF };
+	const float w8_3[2] = { -AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF };
+	float u[4][2], d[4][2];
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		u[t][0] = v[t][0] + v[t + 4][0]; u[t][1] = v[t][1] + v[t + 4][1];
+		d[t][0] = v[t][0] - v[t + 4][0]; d[t][1] = v[t][1] - v[t + 4][1];
+	}
+	am_fft_cmul(d[1], w8_1);
+	float d2r = d[2][0];
+	d[2][0] = j * d[2][1];
+	d[2][1] = -j * d2r;
+	am_fft_cmul(d[3], w8_3);
+	am_fft_radix4(u, j);
+	am_fft_radix4(d, j);
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		v[2 * t][0] = u[t][0]; v[2 * t][1] = u[t][1];
+		v[2 * t + 1][0] = d[t][0]; v[2 * t + 1][1] = d[t][1];
+	}
+}
+
+static inline void am_fft_butterfly(float (*v)[2], unsigned int radix, float j)
+{
+	switch (radix)
+	{
+		case 2: am_fft_radix2(v); break;
+		case 3: am_fft_radix3(v, j); break;
+		case 4: am_fft_radix4(v, j); break;
+		case 5: am_fft_radix5(v, j); break;
+		default: am_fft_radix8(v, j); break;
+	}
+}
+
+// Stockham stages. The defaults take the shape of the stage at run time, fixed-size plans instantiate them with R, M and S
+// so that the shape folds into constants and the loops unroll:
+template <unsigned int R = 0, unsigned int M = 0, unsigned int S = 0>
+static void am_fft_stockham_stage(const am_fft_complex_t *x, am_fft_complex_t *y, unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
+{
+	if (R)
+	{
+		radix = R;
+		m = M;
+		s = S;
+	}
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	float v[8][2];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int q = 0; q < s; q++)
+		{
+			for (unsigned int t = 0; t < radix; t++)
+			{
+				v[t][0] = x[q + s * (p + t * m)][0];
+				v[t][1] = x[q + s * (p + t * m)][1];
+			}
+			am_fft_butterfly(v, radix, j);
+			for (unsigned int k = 0; k < radix; k++)
+			{
+				if (k > 0)
+					am_fft_cmul(v[k], twiddles + 2 * ((k - 1) * m + p));
+				y[q + s * (radix * p + k)][0] = v[k][0];
+				y[q + s * (radix * p + k)][1] = v[k][1];
+			}
+		}
+	}
+}
+
+// Column stages: element e of the transform is a row of lanes contiguous complex values at x + e * x_stride (and y + e * y_stride),
+// every lane is a separate transform sharing the twiddles of the stage.
+static void am_fft_column_stage(const am_fft_complex_t *x, unsigned int x_stride, am_fft_complex_t *y, unsigned int y_stride, unsigned int lanes,
+                                unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
+{
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	float v[8][2];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int q = 0; q < s; q++)
+		{
+			for (unsigned int c = 0; c < lanes; c++)
+			{
+				for (unsigned int t = 0; t < radix; t++)
+				{
+					v[t][0] = x[(q + s * (p + t * m)) * x_stride + c][0];
+					v[t][1] = x[(q + s * (p + t * m)) * x_stride + c][1];
+				}
+				am_fft_butterfly(v, radix, j);
+				for (unsigned int k = 0; k < radix; k++)
+				{
+					if (k > 0)
+						am_fft_cmul(v[k], twiddles + 2 * ((k - 1) * m + p));
+					y[(q + s * (radix * p + k)) * y_stride + c][0] = v[k][0];
+					y[(q + s * (radix * p + k)) * y_stride + c][1] = v[k][1];
+				}
+			}
+		}
+	}
+}
+
+#ifndef AM_FFT_NO_SSE2
+// a * w for 2 interleaved complex values:
+static inline __m128 am_fft_cmul_sse2(__m128 a, __m128 w)
+{
+	const __m128 sign = _mm_castsi128_ps(_mm_setr_epi32((int)0x80000000, 0, (int)0x80000000, 0));
+	__m128 wr = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 0, 0));
+	__m128 wi = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128 a_swapped = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_add_ps(_mm_mul_ps(a, wr), _mm_xor_ps(_mm_mul_ps(a_swapped, wi), sign));
+}
+
+// Rotation by j, or by -j with the negated mask:
+static inline __m128 am_fft_rot_sse2(__m128 a, __m128 mask)
+{
+	return _mm_xor_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), mask);
+}
+
+static inline void am_fft_radix3_sse2(__m128 *v, __m128 rot)
+{
+	__m128 t1 = _mm_add_ps(v[1], v[2]);
+	__m128 t2 = _mm_sub_ps(v[0], _mm_mul_ps(_mm_set1_ps(0.5f), t1));
+	__m128 jt3 = am_fft_rot_sse2(_mm_mul_ps(_mm_set1_ps(AM_FFT_SIN_60), _mm_sub_ps(v[1], v[2])), rot);
+	v[0] = _mm_add_ps(v[0], t1);
+	v[1] = _mm_sub_ps(t2, jt3);
+	v[2] = _mm_add_ps(t2, jt3);
+}
+
+static inline void am_fft_radix5_sse2(__m128 *v, __m128 rot)
+{
+	const __m128 cos_72 = _mm_set1_ps(AM_FFT_COS_72);
+	const __m128 cos_144 = _mm_set1_ps(AM_FFT_COS_144);
+	const __m128 sin_72 = _mm_set1_ps(AM_FFT_SIN_72);
+	const __m128 sin_144 = _mm_set1_ps(AM_FFT_SIN_144);
+	__m128 s1 = _mm_add_ps(v[1], v[4]);
+	__m128 s2 = _mm_add_ps(v[2], v[3]);
+	__m128 d1 = _mm_sub_ps(v[1], v[4]);
+	__m128 d2 = _mm_sub_ps(v[2], v[3]);
+	__m128 a1 = _mm_add_ps(v[0], _mm_add_ps(_mm_mul_ps(cos_72, s1), _mm_mul_ps(cos_144, s2)));
+	__m128 a2 = _mm_add_ps(v[0], _mm_add_ps(_mm_mul_ps(cos_144, s1), _mm_mul_ps(cos_72, s2)));
+	__m128 jb1 = am_fft_rot_sse2(_mm_add_ps(_mm_mul_ps(sin_72, d1), _mm_mul_ps(sin_144, d2)), rot);
+	__m128 jb2 = am_fft_rot_sse2(_mm_sub_ps(_mm_mul_ps(sin_144, d1), _mm_mul_ps(sin_72, d2)), rot);
+	v[0] = _mm_add_ps(v[0], _mm_add_ps(s1, s2));
+	v[1] = _mm_sub_ps(a1, jb1);
+	v[4] = _mm_add_ps(a1, jb1);
+	v[2] = _mm_sub_ps(a2, jb2);
+	v[3] = _mm_add_ps(a2, jb2);
+}
+
+static inline void am_fft_radix4_sse2(__m128 *v, __m128 rot)
+{
+	__m128 apc = _mm_add_ps(v[0], v[2]);
+	__m128 amc = _mm_sub_ps(v[0], v[2]);
+	__m128 bpd = _mm_add_ps(v[1], v[3]);
+	__m128 jbmd = am_fft_rot_sse2(_mm_sub_ps(v[1], v[3]), rot);
+	v[0] = _mm_add_ps(apc, bpd);
+	v[1] = _mm_sub_ps(amc, jbmd);
+	v[2] = _mm_sub_ps(apc, bpd);
+	v[3] = _mm_add_ps(amc, jbmd);
+}
+
+// Splits into two radix-4 dfts of the sums and the twiddled differences, the outputs interleave back into v:
+static inline void am_fft_radix8_sse2(__m128 *v, __m128 rot, __m128 w8_1, __m128 w8_3)
+{
+	const __m128 negate = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	__m128 u[4], d[4];
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		u[t] = _mm_add_ps(v[t], v[t + 4]);
+		d[t] = _mm_sub_ps(v[t], v[t + 4]);
+	}
+	d[1] = am_fft_cmul_sse2(d[1], w8_1);
+	d[2] = am_fft_rot_sse2(d[2], _mm_xor_ps(rot, negate));
+	d[3] = am_fft_cmul_sse2(d[3], w8_3);
+	am_fft_radix4_sse2(u, rot);
+	am_fft_radix4_sse2(d, rot);
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		v[2 * t] = u[t];
+		v[2 * t + 1] = d[t];
+	}
+}
+
+static inline void am_fft_butterfly_sse2(__m128 *v, unsigned int radix, __m128 rot, __m128 w8_1, __m128 w8_3)
+{
+	switch (radix)
+	{
+		case 2:
+		{
+			__m128 d = _mm_sub_ps(v[0], v[1]);
+			v[0] = _mm_add_ps(v[0], v[1]);
+			v[1] = d;
+			break;
+		}
+		case 3: am_fft_radix3_sse2(v, rot); break;
+		case 4: am_fft_radix4_sse2(v, rot); break;
+		case 5: am_fft_radix5_sse2(v, rot); break;
+		default: am_fft_radix8_sse2(v, rot, w8_1, w8_3); break;
+	}
+}
+
+// Stages with an even s, or s == 1 with an even m for radix 4 and 8:
+template <unsigned int R = 0, unsigned int M = 0, unsigned int S = 0>
+static void am_fft_stockham_stage_sse2(const am_fft_complex_t *x, am_fft_complex_t *y, unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
+{
+	if (R)
+	{
+		radix = R;
+		m = M;
+		s = S;
+	}
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	const __m128 rot = direction == AM_FFT_FORWARD ? _mm_castsi128_ps(_mm_setr_epi32((int)0x80000000, 0, (int)0x80000000, 0))
+	                                               : _mm_castsi128_ps(_mm_setr_epi32(0, (int)0x80000000, 0, (int)0x80000000));
+	const __m128 w8_1 = _mm_setr_ps(AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF);
+	const __m128 w8_3 = _mm_setr_ps(-AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, -AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF);
+	__m128 v[8];
+	if (s == 1)
+	{
+		// Two butterflies p and p + 1 side by side, their outputs are r apart so pairs of registers get transposed on the way out:
+		for (unsigned int p = 0; p < m; p += 2)
+		{
+			for (unsigned int t = 0; t < radix; t++)
+				v[t] = _mm_loadu_ps(&x[p + t * m][0]);
+			if (radix == 8)
+				am_fft_radix8_sse2(v, rot, w8_1, w8_3);
+			else
+				am_fft_radix4_sse2(v, rot);
+			for (unsigned int k = 1; k < radix; k++)
+				v[k] = am_fft_cmul_sse2(v[k], _mm_loadu_ps(twiddles + 2 * ((k - 1) * m + p)));
+			for (unsigned int k = 0; k < radix; k += 2)
+			{
+				_mm_storeu_ps(&y[radix * p + k][0], _mm_movelh_ps(v[k], v[k + 1]));
+				_mm_storeu_ps(&y[radix * (p + 1) + k][0], _mm_movehl_ps(v[k + 1], v[k]));
+			}
+		}
+		return;
+	}
+
+	__m128 w[8];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int k = 1; k < radix; k++)
+			w[k] = _mm_castpd_ps(_mm_load1_pd((const double*)(twiddles + 2 * ((k - 1) * m + p))));
+		for (unsigned int q = 0; q < s; q += 2)
+		{
+			for (unsigned int t = 0; t < radix; t++)
+				v[t] = _mm_loadu_ps(&x[q + s * (p + t * m)][0]);
+			am_fft_butterfly_sse2(v, radix, rot, w8_1, w8_3);
+			_mm_storeu_ps(&y[q + s * radix * p][0], v[0]);
+			for (unsigned int k = 1; k < radix; k++)
+				_mm_storeu_ps(&y[q + s * (radix * p + k)][0], m > 1 ? am_fft_cmul_sse2(v[k], w[k]) : v[k]);
+		}
+	}
+}
+
+// Even lane counts:
+static void am_fft_column_stage_sse2(const am_fft_complex_t *x, unsigned int x_stride, am_fft_complex_t *y, unsigned int y_stride, unsigned int lanes,
+                                     unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
+{
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	const __m128 rot = direction == AM_FFT_FORWARD ? _mm_castsi128_ps(_mm_setr_epi32((int)0x80000000, 0, (int)0x80000000, 0))
+	                                               : _mm_castsi128_ps(_mm_setr_epi32(0, (int)0x80000000, 0, (int)0x80000000));
+	const __m128 w8_1 = _mm_setr_ps(AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF);
+	const __m128 w8_3 = _mm_setr_ps(-AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, -AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF);
+	__m128 v[8], w[8];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int k = 1; k < radix; k++)
+			w[k] = _mm_castpd_ps(_mm_load1_pd((const double*)(twiddles + 2 * ((k - 1) * m + p))));
+		for (unsigned int q = 0; q < s; q++)
+		{
+			const am_fft_complex_t *x_rows[8];
+			am_fft_complex_t *y_rows[8];
+			for (unsigned int t = 0; t < radix; t++)
+			{
+				x_rows[t] = x + (q + s * (p + t * m)) * x_stride;
+				y_rows[t] = y + (q + s * (radix * p + t)) * y_stride;
+			}
+			for (unsigned int c = 0; c < lanes; c += 2)
+			{
+				for (unsigned int t = 0; t < radix; t++)
+					v[t] = _mm_loadu_ps(&x_rows[t][c][0]);
+				am_fft_butterfly_sse2(v, radix, rot, w8_1, w8_3);
+				_mm_storeu_ps(&y_rows[0][c][0], v[0]);
+				for (unsigned int k = 1; k < radix; k++)
+					_mm_storeu_ps(&y_rows[k][c][0], m > 1 ? am_fft_cmul_sse2(v[k], w[k]) : v[k]);
+			}
+		}
+	}
+}
+#endif
+
+#ifndef AM_FFT_NO_AVX2
+// Same as above on 4 complex values, a * w is one fmaddsub:
+AM_FFT_TARGET_AVX2 static inline __m256 am_fft_cmul_avx2(__m256 a, __m256 w)
+{
+	__m256 a_swapped = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm256_fmaddsub_ps(a, _mm256_moveldup_ps(w), _mm256_mul_ps(a_swapped, _mm256_movehdup_ps(w)));
+}
+
+AM_FFT_TARGET_AVX2 static inline __m256 am_fft_rot_avx2(__m256 a, __m256 mask)
+{
+	return _mm256_xor_ps(_mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)), mask);
+}
+
+AM_FFT_TARGET_AVX2 static inline void am_fft_radix4_avx2(__m256 *v, __m256 rot)
+{
+	__m256 apc = _mm256_add_ps(v[0], v[2]);
+	__m256 amc = _mm256_sub_ps(v[0], v[2]);
+	__m256 bpd = _mm256_add_ps(v[1], v[3]);
+	__m256 jbmd = am_fft_rot_avx2(_mm256_sub_ps(v[1], v[3]), rot);
+	v[0] = _mm256_add_ps(apc, bpd);
+	v[1] = _mm256_sub_ps(amc, jbmd);
+	v[2] = _mm256_sub_ps(apc, bpd);
+	v[3] = _mm256_add_ps(amc, jbmd);
+}
+
+AM_FFT_TARGET_AVX2 static inline void am_fft_radix8_avx2(__m256 *v, __m256 rot, __m256 w8_1, __m256 w8_3)
+{
+	const __m256 negate = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	__m256 u[4], d[4];
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		u[t] = _mm256_add_ps(v[t], v[t + 4]);
+		d[t] = _mm256_sub_ps(v[t], v[t + 4]);
+	}
+	d[1] = am_fft_cmul_avx2(d[1], w8_1);
+	d[2] = am_fft_rot_avx2(d[2], _mm256_xor_ps(rot, negate));
+	d[3] = am_fft_cmul_avx2(d[3], w8_3);
+	am_fft_radix4_avx2(u, rot);
+	am_fft_radix4_avx2(d, rot);
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		v[2 * t] = u[t];
+		v[2 * t + 1] = d[t];
+	}
+}
+
+// Radix-4 and radix-8 stages with s a multiple of 4:
+template <unsigned int R = 0, unsigned int M = 0, unsigned int S = 0>
+AM_FFT_TARGET_AVX2 static void am_fft_stockham_stage_avx2(const am_fft_complex_t *x, am_fft_complex_t *y, unsigned int m, unsigned int s, unsigned int radix,
+                                                          const float *twiddles, int direction)
+{
+	if (R)
+	{
+		radix = R;
+		m = M;
+		s = S;
+	}
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	const __m256 rot = direction == AM_FFT_FORWARD ? _mm256_castsi256_ps(_mm256_set1_epi64x(0x80000000LL))
+	                                               : _mm256_castsi256_ps(_mm256_set1_epi64x((long long)0x8000000000000000ULL));
+	const __m256 w8_1 = _mm256_setr_ps(AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF,
+	                                   AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF);
+	const __m256 w8_3 = _mm256_xor_ps(w8_1, _mm256_castsi256_ps(_mm256_set1_epi64x(0x80000000LL)));
+	__m256 v[8], w[8];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int k = 1; k < radix; k++)
+			w[k] = _mm256_castpd_ps(_mm256_broadcast_sd((const double*)(twiddles + 2 * ((k - 1) * m + p))));
+		for (unsigned int q = 0; q < s; q += 4)
+		{
+			for (unsigned int t = 0; t < radix; t++)
+				v[t] = _mm256_loadu_ps(&x[q + s * (p + t * m)][0]);
+			if (radix == 8)
+				am_fft_radix8_avx2(v, rot, w8_1, w8_3);
+			else
+				am_fft_radix4_avx2(v, rot);
+			_mm256_storeu_ps(&y[q + s * radix * p][0], v[0]);
+			for (unsigned int k = 1; k < radix; k++)
+				_mm256_storeu_ps(&y[q + s * (radix * p + k)][0], m > 1 ? am_fft_cmul_avx2(v[k], w[k]) : v[k]);
+		}
+	}
+}
+
+// Radix-4 and radix-8 column stages over a multiple of 4 lanes:
+AM_FFT_TARGET_AVX2 static void am_fft_column_stage_avx2(const am_fft_complex_t *x, unsigned int x_stride, am_fft_complex_t *y, unsigned int y_stride, unsigned int lanes,
+                                                        unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
+{
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	const __m256 rot = direction == AM_FFT_FORWARD ? _mm256_castsi256_ps(_mm256_set1_epi64x(0x80000000LL))
+	                                               : _mm256_castsi256_ps(_mm256_set1_epi64x((long long)0x8000000000000000ULL));
+	const __m256 w8_1 = _mm256_setr_ps(AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF,
+	                                   AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF, AM_FFT_SQRT_HALF, -j * AM_FFT_SQRT_HALF);
+	const __m256 w8_3 = _mm256_xor_ps(w8_1, _mm256_castsi256_ps(_mm256_set1_epi64x(0x80000000LL)));
+	__m256 v[8], w[8];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int k = 1; k < radix; k++)
+			w[k] = _mm256_castpd_ps(_mm256_broadcast_sd((const double*)(twiddles + 2 * ((k - 1) * m + p))));
+		for (unsigned int q = 0; q < s; q++)
+		{
+			const am_fft_complex_t *x_rows[8];
+			am_fft_complex_t *y_rows[8];
+			for (unsigned int t = 0; t < radix; t++)
+			{
+				x_rows[t] = x + (q + s * (p + t * m)) * x_stride;
+				y_rows[t] = y + (q + s * (radix * p + t)) * y_stride;
+			}
+			for (unsigned int c = 0; c < lanes; c += 4)
+			{
+				for (unsigned int t = 0; t < radix; t++)
+					v[t] = _mm256_loadu_ps(&x_rows[t][c][0]);
+				if (radix == 8)
+					am_fft_radix8_avx2(v, rot, w8_1, w8_3);
+				else
+					am_fft_radix4_avx2(v, rot);
+				_mm256_storeu_ps(&y_rows[0][c][0], v[0]);
+				for (unsigned int k = 1; k < radix; k++)
+					_mm256_storeu_ps(&y_rows[k][c][0], m > 1 ? am_fft_cmul_avx2(v[k], w[k]) : v[k]);
+			}
+		}
+	}
+}
 #endif
 
-struct am_fft_plan_1d_
+#ifndef AM_FFT_NO_AVX512
+// Same as above on 8 complex values, the twiddle is split into broadcast real and imaginary parts:
+AM_FFT_TARGET_AVX512 static inline __m512 am_fft_cmul_avx512(__m512 a, __m512 wr, __m512 wi)
 {
-	float *cos_table;
-	float *sin_table;
-	unsigned int *twiddle_table;
-	unsigned int n;
-	int direction;
+	__m512 a_swapped = _mm512_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm512_fmaddsub_ps(a, wr, _mm512_mul_ps(a_swapped, wi));
+}
+
+AM_FFT_TARGET_AVX512 static inline __m512 am_fft_rot_avx512(__m512 a, __m512i mask)
+{
+	return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1))), mask));
+}
+
+AM_FFT_TARGET_AVX512 static inline void am_fft_radix4_avx512(__m512 *v, __m512i rot)
+{
+	__m512 apc = _mm512_add_ps(v[0], v[2]);
+	__m512 amc = _mm512_sub_ps(v[0], v[2]);
+	__m512 bpd = _mm512_add_ps(v[1], v[3]);
+	__m512 jbmd = am_fft_rot_avx512(_mm512_sub_ps(v[1], v[3]), rot);
+	v[0] = _mm512_add_ps(apc, bpd);
+	v[1] = _mm512_sub_ps(amc, jbmd);
+	v[2] = _mm512_sub_ps(apc, bpd);
+	v[3] = _mm512_add_ps(amc, jbmd);
+}
+
+AM_FFT_TARGET_AVX512 static inline void am_fft_radix8_avx512(__m512 *v, __m512i rot, __m512 c, __m512 jc)
+{
+	__m512 u[4], d[4];
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		u[t] = _mm512_add_ps(v[t], v[t + 4]);
+		d[t] = _mm512_sub_ps(v[t], v[t + 4]);
+	}
+	d[1] = am_fft_cmul_avx512(d[1], c, jc);
+	d[2] = am_fft_rot_avx512(d[2], _mm512_xor_si512(rot, _mm512_set1_epi32((int)0x80000000)));
+	d[3] = am_fft_cmul_avx512(d[3], _mm512_sub_ps(_mm512_setzero_ps(), c), jc);
+	am_fft_radix4_avx512(u, rot);
+	am_fft_radix4_avx512(d, rot);
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		v[2 * t] = u[t];
+		v[2 * t + 1] = d[t];
+	}
+}
+
+// Radix-4 and radix-8 stages with s a multiple of 8:
+template <unsigned int R = 0, unsigned int M = 0, unsigned int S = 0>
+AM_FFT_TARGET_AVX512 static void am_fft_stockham_stage_avx512(const am_fft_complex_t *x, am_fft_complex_t *y, unsigned int m, unsigned int s, unsigned int radix,
+                                                              const float *twiddles, int direction)
+{
+	if (R)
+	{
+		radix = R;
+		m = M;
+		s = S;
+	}
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	const __m512i rot = direction == AM_FFT_FORWARD ? _mm512_set1_epi64(0x80000000LL) : _mm512_set1_epi64((long long)0x8000000000000000ULL);
+	const __m512 c = _mm512_set1_ps(AM_FFT_SQRT_HALF);
+	const __m512 jc = _mm512_set1_ps(-j * AM_FFT_SQRT_HALF);
+	__m512 v[8], wr[8], wi[8];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int k = 1; k < radix; k++)
+		{
+			wr[k] = _mm512_set1_ps(twiddles[2 * ((k - 1) * m + p)]);
+			wi[k] = _mm512_set1_ps(twiddles[2 * ((k - 1) * m + p) + 1]);
+		}
+		for (unsigned int q = 0; q < s; q += 8)
+		{
+			for (unsigned int t = 0; t < radix; t++)
+				v[t] = _mm512_loadu_ps(&x[q + s * (p + t * m)][0]);
+			if (radix == 8)
+				am_fft_radix8_avx512(v, rot, c, jc);
+			else
+				am_fft_radix4_avx512(v, rot);
+			_mm512_storeu_ps(&y[q + s * radix * p][0], v[0]);
+			for (unsigned int k = 1; k < radix; k++)
+				_mm512_storeu_ps(&y[q + s * (radix * p + k)][0], m > 1 ? am_fft_cmul_avx512(v[k], wr[k], wi[k]) : v[k]);
+		}
+	}
+}
+
+// Radix-4 and radix-8 column stages over a multiple of 8 lanes:
+AM_FFT_TARGET_AVX512 static void am_fft_column_stage_avx512(const am_fft_complex_t *x, unsigned int x_stride, am_fft_complex_t *y, unsigned int y_stride, unsigned int lanes,
+                                                            unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
+{
+	float j = direction == AM_FFT_FORWARD ? 1.0f : -1.0f;
+	const __m512i rot = direction == AM_FFT_FORWARD ? _mm512_set1_epi64(0x80000000LL) : _mm512_set1_epi64((long long)0x8000000000000000ULL);
+	const __m512 c8 = _mm512_set1_ps(AM_FFT_SQRT_HALF);
+	const __m512 jc8 = _mm512_set1_ps(-j * AM_FFT_SQRT_HALF);
+	__m512 v[8], wr[8], wi[8];
+	for (unsigned int p = 0; p < m; p++)
+	{
+		for (unsigned int k = 1; k < radix; k++)
+		{
+			wr[k] = _mm512_set1_ps(twiddles[2 * ((k - 1) * m + p)]);
+			wi[k] = _mm512_set1_ps(twiddles[2 * ((k - 1) * m + p) + 1]);
+		}
+		for (unsigned int q = 0; q < s; q++)
+		{
+			const am_fft_complex_t *x_rows[8];
+			am_fft_complex_t *y_rows[8];
+			for (unsigned int t = 0; t < radix; t++)
+			{
+				x_rows[t] = x + (q + s * (p + t * m)) * x_stride;
+				y_rows[t] = y + (q + s * (radix * p + t)) * y_stride;
+			}
+			for (unsigned int c = 0; c < lanes; c += 8)
+			{
+				for (unsigned int t = 0; t < radix; t++)
+					v[t] = _mm512_loadu_ps(&x_rows[t][c][0]);
+				if (radix == 8)
+					am_fft_radix8_avx512(v, rot, c8, jc8);
+				else
+					am_fft_radix4_avx512(v, rot);
+				_mm512_storeu_ps(&y_rows[0][c][0], v[0]);
+				for (unsigned int k = 1; k < radix; k++)
+					_mm512_storeu_ps(&y_rows[k][c][0], m > 1 ? am_fft_cmul_avx512(v[k], wr[k], wi[k]) : v[k]);
+			}
+		}
+	}
+}
+#endif
+
+// Fixed-size stockham kernels. The radices follow am_fft_stockham_radices for powers of two: 4s first, then 8s.
+static constexpr unsigned int am_fft_log2(unsigned int n)
+{
+	return n > 1 ? 1 + am_fft_log2(n / 2) : 0;
+}
+
+static constexpr unsigned int am_fft_fixed_fours(unsigned int n)
+{
+	return am_fft_log2(n) % 3 == 1 ? 2 : am_fft_log2(n) % 3 == 2 ? 1 : 0;
+}
+
+// Radix of the stage that leaves length values per transform of an n-point dft:
+static constexpr unsigned int am_fft_fixed_radix(unsigned int n, unsigned int length)
+{
+	return am_fft_log2(n / length) < 2 * am_fft_fixed_fours(n) ? 4 : 8;
+}
+
+static constexpr unsigned int am_fft_fixed_stages(unsigned int n)
+{
+	return am_fft_fixed_fours(n) + (am_fft_log2(n) - 2 * am_fft_fixed_fours(n)) / 3;
+}
+
+// One stage with the kernel am_fft_stockham would pick, chosen at compile time apart from the instruction set:
+template <unsigned int R, unsigned int M, unsigned int S>
+static void am_fft_stockham_stage_fixed(int simd, const am_fft_complex_t *x, am_fft_complex_t *y, const float *twiddles, int direction)
+{
+	(void)simd;
+	#ifndef AM_FFT_NO_AVX512
+	if (simd == AM_FFT_SIMD_AVX512 && S % 8 == 0)
+	{
+		am_fft_stockham_stage_avx512<R, M, S>(x, y, M, S, R, twiddles, direction);
+		return;
+	}
+	#endif
+	#ifndef AM_FFT_NO_AVX2
+	if (simd >= AM_FFT_SIMD_AVX2 && S % 4 == 0)
+	{
+		am_fft_stockham_stage_avx2<R, M, S>(x, y, M, S, R, twiddles, direction);
+		return;
+	}
+	#endif
+	#ifndef AM_FFT_NO_SSE2
+	if (S % 2 == 0 || (S == 1 && M % 2 == 0))
+	{
+		am_fft_stockham_stage_sse2<R, M, S>(x, y, M, S, R, twiddles, direction);
+		return;
+	}
+	#endif
+	am_fft_stockham_stage<R, M, S>(x, y, M, S, R, twiddles, direction);
+}
+
+// Stages from length values per transform down, stride S. x is read, y written and z the buffer of the following stage:
+template <unsigned int N, unsigned int L = N, unsigned int S = 1>
+struct am_fft_stockham_fixed_stages
+{
+	static void run(int simd, const am_fft_complex_t *x, am_fft_complex_t *y, am_fft_complex_t *z, const float *twiddles, int direction)
+	{
+		const unsigned int R = am_fft_fixed_radix(N, L);
+		am_fft_stockham_stage_fixed<R, L / R, S>(simd, x, y, twiddles, direction);
+		am_fft_stockham_fixed_stages<N, L / R, S * R>::run(simd, y, z, y, twiddles + 2 * (R - 1) * (L / R), direction);
+	}
 };
 
-struct am_fft_plan_2d_
+template <unsigned int N, unsigned int S>
+struct am_fft_stockham_fixed_stages<N, 1, S>
 {
-	am_fft_plan_1d_t *x;
-	am_fft_plan_1d_t *y;
-	am_fft_complex_t *tmp;
-	void *__pad0;
+	static void run(int, const am_fft_complex_t*, am_fft_complex_t*, am_fft_complex_t*, const float*, int)
+	{
+	}
 };
 
-am_fft_plan_1d_t* am_fft_plan_1d(int direction, unsigned int n)
+template <unsigned int N>
+static void am_fft_stockham_fixed(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch)
 {
-	unsigned int levels = 0;
-	for (unsigned int temp = n; temp > 1; temp >>= 1)
-		levels++;
-	if (1U << levels != n)
-		return 0;
-	
-	void *mem = AM_FFT_ALLOC(sizeof(am_fft_plan_1d_t) + n * sizeof(unsigned int) + n * sizeof(float));
-	am_fft_plan_1d_t *plan = (am_fft_plan_1d_t*)mem;
-	plan->twiddle_table = (unsigned int*)(plan + 1);
-	plan->cos_table = (float*)(plan->twiddle_table + n);
-	plan->sin_table = plan->cos_table + n / 2;
-	plan->n = n;
-	plan->direction = direction;
-	
-	for (unsigned int i = 0; i < n; i++)
+	// Ping-pong so that the last stage lands in out:
+	am_fft_complex_t *first = am_fft_fixed_stages(N) & 1 ? out : scratch;
+	am_fft_complex_t *second = am_fft_fixed_stages(N) & 1 ? scratch : out;
+	am_fft_stockham_fixed_stages<N>::run(plan->simd, in, first, second, plan->stockham_twiddles, plan->direction);
+}
+
+// The cascade sizes of the ocean:
+static am_fft_stockham_fixed_t am_fft_stockham_fixed_find(unsigned int n)
+{
+	switch (n)
 	{
-		unsigned int j = 0;
-		unsigned int bits = i;
-		for (unsigned int l = 0; l < levels; l++, bits >>= 1)
-			j = (j << 1) | (bits & 1);
-		plan->twiddle_table[i] = j;
+	case 64: return am_fft_stockham_fixed<64>;
+	case 128: return am_fft_stockham_fixed<128>;
+	case 256: return am_fft_stockham_fixed<256>;
+	case 512: return am_fft_stockham_fixed<512>;
+	default: return 0;
 	}
-	
-	const double pi = 3.14159265358979323846; // Don't rely on M_PI being defined
-	const double angle_step = 2.0 * pi / (double)n * (direction == AM_FFT_FORWARD ? 1.0 : -1.0);
-	for (unsigned int i = 0; i < n / 2; i++)
+}
+
+static void am_fft_stockham(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch)
+{
+	if (plan->fixed)
 	{
-		double angle = (double)i * angle_step;
-		plan->cos_table[i] = (float)cos(angle);
-		plan->sin_table[i] = (float)sin(angle);
+		plan->fixed(plan, in, out, scratch);
+		return;
+	}
+	unsigned int n = plan->n;
+	unsigned int radices[AM_FFT_MAX_STAGES];
+	unsigned int stages = am_fft_stockham_radices(n, radices);
+
+	// Ping-pong so that the last stage lands in out:
+	am_fft_complex_t *buffers[2] = { out, scratch };
+	unsigned int target = stages & 1 ? 0 : 1;
+	const am_fft_complex_t *x = in;
+	const float *twiddles = plan->stockham_twiddles;
+	for (unsigned int i = 0, s = 1, length = n; i < stages; i++)
+	{
+		unsigned int radix = radices[i];
+		unsigned int m = length / radix;
+		am_fft_complex_t *y = buffers[target];
+		int wide = radix == 4 || radix == 8;
+		(void)wide;
+		#ifndef AM_FFT_NO_AVX512
+		if (plan->simd == AM_FFT_SIMD_AVX512 && wide && s % 8 == 0)
+			am_fft_stockham_stage_avx512(x, y, m, s, radix, twiddles, plan->direction);
+		else
+		#endif
+		#ifndef AM_FFT_NO_AVX2
+		if (plan->simd >= AM_FFT_SIMD_AVX2 && wide && s % 4 == 0)
+			am_fft_stockham_stage_avx2(x, y, m, s, radix, twiddles, plan->direction);
+		else
+		#endif
+		#ifndef AM_FFT_NO_SSE2
+		if (s % 2 == 0 || (s == 1 && wide && m % 2 == 0))
+			am_fft_stockham_stage_sse2(x, y, m, s, radix, twiddles, plan->direction);
+		else
+		#endif
+			am_fft_stockham_stage(x, y, m, s, radix, twiddles, plan->direction);
+		x = y;
+		target ^= 1;
+		twiddles += 2 * (radix - 1) * m;
+		s *= radix;
+		length = m;
 	}
-	
-	return plan;
 }
 
-void am_fft_plan_1d_free(am_fft_plan_1d_t *plan)
+// Splits the lanes of a column stage over the widest kernels that fit:
+static void am_fft_column_stage_dispatch(int simd, const am_fft_complex_t *x, unsigned int x_stride, am_fft_complex_t *y, unsigned int y_stride, unsigned int lanes,
+                                         unsigned int m, unsigned int s, unsigned int radix, const float *twiddles, int direction)
 {
-	AM_FFT_FREE(plan);
+	int wide = radix == 4 || radix == 8;
+	unsigned int c = 0;
+	(void)simd; (void)wide;
+	#ifndef AM_FFT_NO_AVX512
+	unsigned int count8 = (lanes - c) & ~7U;
+	if (simd == AM_FFT_SIMD_AVX512 && wide && count8)
+	{
+		am_fft_column_stage_avx512(x + c, x_stride, y + c, y_stride, count8, m, s, radix, twiddles, direction);
+		c += count8;
+	}
+	#endif
+	#ifndef AM_FFT_NO_AVX2
+	unsigned int count4 = (lanes - c) & ~3U;
+	if (simd >= AM_FFT_SIMD_AVX2 && wide && count4)
+	{
+		am_fft_column_stage_avx2(x + c, x_stride, y + c, y_stride, count4, m, s, radix, twiddles, direction);
+		c += count4;
+	}
+	#endif
+	#ifndef AM_FFT_NO_SSE2
+	unsigned int count2 = (lanes - c) & ~1U;
+	if (count2)
+	{
+		am_fft_column_stage_sse2(x + c, x_stride, y + c, y_stride, count2, m, s, radix, twiddles, direction);
+		c += count2;
+	}
+	#endif
+	if (c < lanes)
+		am_fft_column_stage(x + c, x_stride, y + c, y_stride, lanes - c, m, s, radix, twiddles, direction);
+}
+
+void am_fft_1d_columns(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int stride, unsigned int count, am_fft_complex_t *scratch)
+{
+	unsigned int n = plan->n;
+	for (unsigned int c0 = 0; c0 < count; c0 += AM_FFT_COLUMN_BATCH)
+	{
+		unsigned int lanes = count - c0 < AM_FFT_COLUMN_BATCH ? count - c0 : AM_FFT_COLUMN_BATCH;
+		if (plan->engine != AM_FFT_ENGINE_STOCKHAM)
+		{
+			// Small powers of two and four-step sizes: gather each column, transform and scatter back:
+			for (unsigned int c = c0; c < c0 + lanes; c++)
+			{
+				for (unsigned int i = 0; i < n; i++)
+				{
+					scratch[i][0] = in[i * stride + c][0];
+					scratch[i][1] = in[i * stride + c][1];
+				}
+				am_fft_1d_scratch(plan, scratch, scratch + n, scratch + 2 * n);
+				for (unsigned int i = 0; i < n; i++)
+				{
+					out[i * stride + c][0] = scratch[n + i][0];
+					out[i * stride + c][1] = scratch[n + i][1];
+				}
+			}
+			continue;
+		}
+
+		unsigned int radices[AM_FFT_MAX_STAGES];
+		unsigned int stages = am_fft_stockham_radices(n, radices);
+
+		// The strided columns are only read by the first stage and written by the last one, the stages in between
+		// ping-pong between two compact strips. Rows of a power-of-two stride alias in the caches, so this matters:
+		am_fft_complex_t *strips[2] = { scratch, scratch + n * AM_FFT_COLUMN_BATCH };
+		const am_fft_complex_t *x = in + c0;
+		unsigned int x_stride = stride;
+		const float *twiddles = plan->stockham_twiddles;
+		for (unsigned int i = 0, s = 1, length = n; i < stages; i++)
+		{
+			unsigned int radix = radices[i];
+			unsigned int m = length / radix;
+			am_fft_complex_t *y = i + 1 == stages ? out + c0 : strips[i & 1];
+			unsigned int y_stride = i + 1 == stages ? stride : lanes;
+			am_fft_column_stage_dispatch(plan->simd, x, x_stride, y, y_stride, lanes, m, s, radix, twiddles, plan->direction);
+			x = y;
+			x_stride = y_stride;
+			twiddles += 2 * (radix - 1) * m;
+			s *= radix;
+			length = m;
+		}
+	}
+}
+
+static void am_fft_transpose_rect(const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int width, unsigned int height, unsigned int y_begin, unsigned int y_end);
+
+// Four-step dft of n = n1 * n2 with j = j1 * n2 + j2 and k = k1 + n1 * k2, in its six-step form so that every sub-dft runs on
+// a contiguous row that fits in cache: transpose, n2 row dfts of n1 values times W^(j2 * k1), transpose, n1 row dfts of n2 values
+// and a last transpose into out. The row dfts borrow the next row of scratch, or the already consumed first row of out, as work buffer:
+static void am_fft_four_step(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch)
+{
+	const am_fft_plan_1d_t *columns = plan->four_step[0];
+	const am_fft_plan_1d_t *rows = plan->four_step[1];
+	unsigned int n1 = columns->n;
+	unsigned int n2 = rows->n;
+
+	am_fft_transpose_rect(in, out, n2, n1, 0, n1);
+	for (unsigned int j2 = 0; j2 < n2; j2++)
+	{
+		am_fft_complex_t *y = scratch + j2 * n1;
+		am_fft_1d_scratch(columns, out + j2 * n1, y, j2 + 1 < n2 ? y + n1 : out);
+		const float *twiddles = plan->four_step_twiddles + 2 * j2 * n1;
+		unsigned int k1 = 0;
+		#ifndef AM_FFT_NO_SSE2
+		for (; k1 + 2 <= n1; k1 += 2)
+			_mm_storeu_ps(&y[k1][0], am_fft_cmul_sse2(_mm_loadu_ps(&y[k1][0]), _mm_loadu_ps(twiddles + 2 * k1)));
+		#endif
+		for (; k1 < n1; k1++)
+			am_fft_cmul(y[k1], twiddles + 2 * k1);
+	}
+
+	am_fft_transpose_rect(scratch, out, n1, n2, 0, n2);
+	for (unsigned int k1 = 0; k1 < n1; k1++)
+	{
+		am_fft_complex_t *z = scratch + k1 * n2;
+		am_fft_1d_scratch(rows, out + k1 * n2, z, k1 + 1 < n1 ? z + n2 : out);
+	}
+	am_fft_transpose_rect(scratch, out, n2, n1, 0, n1);
 }
 
 void am_fft_1d(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out)
 {
+	if (plan->engine == AM_FFT_ENGINE_STOCKHAM)
+	{
+		am_fft_stockham(plan, in, out, plan->scratch);
+		return;
+	}
+	if (plan->engine == AM_FFT_ENGINE_FOUR_STEP)
+	{
+		am_fft_four_step(plan, in, out, plan->scratch);
+		return;
+	}
+
 	// Twiddle inputs:
 	unsigned int n = plan->n;
 	unsigned int *twiddle_table = plan->twiddle_table;
@@ -204,65 +1745,194 @@ void am_fft_1d(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_
 		#endif
 	}
 
-	// Remaining passes of the radix-2 FFT:
-	float *cos_table = plan->cos_table;
-	float *sin_table = plan->sin_table;
-	for (unsigned int half = 4; half < n; half <<= 1)
+	// Remaining passes of the radix-2 FFT:
+	const float *twiddles = plan->pass_twiddles;
+	for (unsigned int half = 4; half < n; twiddles += 4 * half, half <<= 1)
+	{
+		#ifndef AM_FFT_NO_AVX512
+		if (plan->simd == AM_FFT_SIMD_AVX512 && half >= 8)
+		{
+			am_fft_pass_avx512(out, n, half, twiddles);
+			continue;
+		}
+		#endif
+		#ifndef AM_FFT_NO_AVX2
+		if (plan->simd >= AM_FFT_SIMD_AVX2)
+		{
+			am_fft_pass_avx2(out, n, half, twiddles);
+			continue;
+		}
+		#endif
+		am_fft_pass(out, n, half, twiddles);
+	}
+}
+
+void am_fft_1d_scratch(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch)
+{
+	if (plan->engine == AM_FFT_ENGINE_STOCKHAM)
+		am_fft_stockham(plan, in, out, scratch);
+	else if (plan->engine == AM_FFT_ENGINE_FOUR_STEP)
+		am_fft_four_step(plan, in, out, scratch);
+	else
+		am_fft_1d(plan, in, out);
+}
+
+// Splits the half-length dft Z of z[j] = x[2j] + i * x[2j + 1] into the dfts A and B of the even and odd samples
+// and combines them into bins 0..half of the real dft, X[k] = A[k] + W^k * B[k]. Works in place on out, which holds half + 1 values:
+static void am_fft_r2c_unfold(am_fft_complex_t *out, unsigned int half, const float *cos_table, const float *sin_table)
+{
+	// Bins k and half - k read the same pair of Z values, X[half - k] = conj(A[k] - W^k * B[k]):
+	for (unsigned int k = 0; k <= half / 2; k++)
+	{
+		unsigned int l = half - k;
+		float ar = out[k][0];
+		float ai = out[k][1];
+		float br = out[k == 0 ? 0 : l][0];
+		float bi = out[k == 0 ? 0 : l][1];
+		float er = 0.5f * (ar + br);
+		float ei = 0.5f * (ai - bi);
+		float or_ = 0.5f * (ai + bi);
+		float oi = 0.5f * (br - ar);
+		float wor = cos_table[k] * or_ - sin_table[k] * oi;
+		float woi = cos_table[k] * oi + sin_table[k] * or_;
+		out[k][0] = er + wor;
+		out[k][1] = ei + woi;
+		out[l][0] = er - wor;
+		out[l][1] = woi - ei;
+	}
+}
+
+// Folds bins 0..half of a hermitian spectrum into the half-length spectrum whose dft is z[j] = x[2j] + i * x[2j + 1]:
+static void am_fft_c2r_fold(const am_fft_complex_t *in, am_fft_complex_t *z, unsigned int half, const float *cos_table, const float *sin_table)
+{
+	for (unsigned int k = 0; k < half; k++)
+	{
+		float ar = in[k][0];
+		float ai = in[k][1];
+		float br = in[half - k][0];
+		float bi = in[half - k][1];
+		float er = ar + br;
+		float ei = ai - bi;
+		float or_ = ar - br;
+		float oi = ai + bi;
+		float wor = cos_table[k] * or_ - sin_table[k] * oi;
+		float woi = cos_table[k] * oi + sin_table[k] * or_;
+		z[k][0] = er - woi;
+		z[k][1] = ei + wor;
+	}
+}
+
+void am_fft_1d_r2c_scratch(const am_fft_plan_1d_t *plan, const float *in, am_fft_complex_t *out, am_fft_complex_t *scratch)
+{
+	unsigned int half = plan->n / 2;
+	am_fft_1d_scratch(plan->half, (const am_fft_complex_t*)in, out, scratch);
+	am_fft_r2c_unfold(out, half, plan->real_cos_table, plan->real_sin_table);
+}
+
+void am_fft_1d_c2r_scratch(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, float *out, am_fft_complex_t *scratch)
+{
+	// z in the first half of scratch, the scratch of the half-length dft in the second:
+	unsigned int half = plan->n / 2;
+	am_fft_c2r_fold(in, scratch, half, plan->real_cos_table, plan->real_sin_table);
+	am_fft_1d_scratch(plan->half, scratch, (am_fft_complex_t*)out, scratch + half);
+}
+
+void am_fft_1d_r2c(const am_fft_plan_1d_t *plan, const float *in, am_fft_complex_t *out)
+{
+	am_fft_1d_r2c_scratch(plan, in, out, plan->half->scratch);
+}
+
+void am_fft_1d_c2r(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, float *out)
+{
+	unsigned int half = plan->n / 2;
+	am_fft_c2r_fold(in, plan->scratch, half, plan->real_cos_table, plan->real_sin_table);
+	am_fft_1d_scratch(plan->half, plan->scratch, (am_fft_complex_t*)out, plan->half->scratch);
+}
+
+// Scratch of the serial passes: a strip of columns, a complex row and the loaded rows of the load functions, or a real row:
+static unsigned int am_fft_2d_serial_scratch_count(unsigned int width, unsigned int height, unsigned int channels)
+{
+	unsigned int columns = 2 * AM_FFT_COLUMN_BATCH * height;
+	return columns > (channels + 1) * width ? columns : (channels + 1) * width;
+}
+
+static void am_fft_measure_2d(am_fft_plan_2d_t *plan);
+
+// Complex and real 2D plans, the real ones keep the (width / 2 + 1) non-redundant columns of the hermitian spectrum
+// and run the row dfts through a real 1D plan. The 1D plans never need their own scratch:
+static am_fft_plan_2d_t* am_fft_plan_2d_create(int direction, unsigned int width, unsigned int height, int real)
+{
+	int flags = direction & (AM_FFT_NO_SCRATCH | AM_FFT_MEASURE);
+	direction &= ~(AM_FFT_NO_SCRATCH | AM_FFT_MEASURE);
+	int measure = flags & AM_FFT_MEASURE;
+	unsigned int tmp_count = (real ? width / 2 + 1 : width) * height;
+	unsigned int scratch_count = am_fft_2d_serial_scratch_count(width, height, 1);
+	void *mem = AM_FFT_ALLOC(sizeof(am_fft_plan_2d_t) + (flags & AM_FFT_NO_SCRATCH ? 0 : sizeof(am_fft_complex_t) * (tmp_count + scratch_count)));
+	am_fft_plan_2d_t *plan = (am_fft_plan_2d_t*)mem;
+	plan->x = real ? am_fft_plan_1d_real(direction | measure | AM_FFT_NO_SCRATCH, width) : am_fft_plan_1d(direction | measure | AM_FFT_NO_SCRATCH, width);
+	plan->y = am_fft_plan_1d(direction | measure | AM_FFT_NO_SCRATCH, height);
+	if (!plan->x || !plan->y)
 	{
-		unsigned int size = half << 1;
-		unsigned int step = n / size;
-		for (unsigned int i = 0; i < n; i += size)
-		{
-			#ifdef AM_FFT_NO_SSE2
-			for (unsigned int j = i, k = 0; j < i + half; j++, k += step)
-			{
-				unsigned int l = j + half;
-				float ar =  out[l][0] * cos_table[k] + out[l][1] * sin_table[k];
-				float ai = -out[l][0] * sin_table[k] + out[l][1] * cos_table[k];
-				out[l][0] = out[j][0] - ar;
-				out[l][1] = out[j][1] - ai;
-				out[j][0] = out[j][0] + ar;
-				out[j][1] = out[j][1] + ai;
-			}
-			#else
-			for (unsigned int j = i, k = 0; j < i + half; j += 2, k += 2 * step)
-			{
-				unsigned int l = j + half;
-				
-				__m128 aribri = _mm_loadu_ps(&out[l][0]);
-				__m128 cridri = _mm_loadu_ps(&out[j][0]);
-				
-				__m128 airbir = _mm_shuffle_ps(aribri, aribri, _MM_SHUFFLE(2, 3, 0, 1));
-				__m128 cos0011 = _mm_setr_ps(cos_table[k], cos_table[k], cos_table[k + step], cos_table[k + step]);
-				__m128 sin0011 = _mm_setr_ps(sin_table[k], -sin_table[k], sin_table[k + step], -sin_table[k + step]);
-				__m128 aribri2 = _mm_add_ps(_mm_mul_ps(aribri, cos0011), _mm_mul_ps(airbir, sin0011));
-				
-				_mm_storeu_ps(&out[l][0], _mm_sub_ps(cridri, aribri2));
-				_mm_storeu_ps(&out[j][0], _mm_add_ps(cridri, aribri2));
-			}
-			#endif
-		}
+		am_fft_plan_2d_free(plan);
+		return 0;
 	}
+	plan->tmp = flags & AM_FFT_NO_SCRATCH ? 0 : (am_fft_complex_t*)(plan + 1);
+	plan->scratch = flags & AM_FFT_NO_SCRATCH ? 0 : plan->tmp + tmp_count;
+	plan->width = width;
+	plan->height = height;
+
+	// Real dfts always run their columns in strips, complex ones take the wisdom for the grid if there is any:
+	am_fft_wisdom_t wisdom;
+	plan->columns = real || width * height < AM_FFT_COLUMNS_MAX_CELLS;
+	if (!real && am_fft_wisdom_find(2, width, height, &wisdom))
+		plan->columns = wisdom.engine;
+	else if (!real && measure)
+		am_fft_measure_2d(plan);
+	return plan;
 }
 
 am_fft_plan_2d_t* am_fft_plan_2d(int direction, unsigned int width, unsigned int height)
 {
-	void *mem = AM_FFT_ALLOC(sizeof(am_fft_plan_2d_t) + sizeof(am_fft_complex_t) * width * height);
-	am_fft_plan_2d_t *plan = (am_fft_plan_2d_t*)mem;
-	plan->x = am_fft_plan_1d(direction, width);
-	plan->y = am_fft_plan_1d(direction, height);
-	plan->tmp = (am_fft_complex_t*)(plan + 1);
-	return plan;
+	return am_fft_plan_2d_create(direction, width, height, 0);
+}
+
+am_fft_plan_2d_t* am_fft_plan_2d_r2c(int direction, unsigned int width, unsigned int height)
+{
+	return am_fft_plan_2d_create(direction, width, height, 1);
+}
+
+am_fft_plan_2d_t* am_fft_plan_2d_c2r(int direction, unsigned int width, unsigned int height)
+{
+	return am_fft_plan_2d_create(direction, width, height, 1);
+}
+
+static unsigned int am_fft_2d_tmp_count(const am_fft_plan_2d_t *plan)
+{
+	unsigned int columns = plan->x->engine == AM_FFT_ENGINE_REAL ? plan->width / 2 + 1 : plan->width;
+	return columns * plan->height;
+}
+
+unsigned int am_fft_2d_scratch_size(const am_fft_plan_2d_t *plan)
+{
+	return am_fft_2d_tmp_count(plan) + am_fft_2d_serial_scratch_count(plan->width, plan->height, 1);
+}
+
+unsigned int am_fft_2d_batch_scratch_size(const am_fft_plan_2d_t *plan, unsigned int count)
+{
+	return count * am_fft_2d_tmp_count(plan) + am_fft_2d_serial_scratch_count(plan->width, plan->height, count);
 }
 
 void am_fft_plan_2d_free(am_fft_plan_2d_t *plan)
 {
-	am_fft_plan_1d_free(plan->x);
-	am_fft_plan_1d_free(plan->y);
+	if (plan->x)
+		am_fft_plan_1d_free(plan->x);
+	if (plan->y)
+		am_fft_plan_1d_free(plan->y);
 	AM_FFT_FREE(plan);
 }
 
-static void am_fft_transpose_square(am_fft_complex_t *m, unsigned int n)
+// Transposes the block rows [y_begin, y_end) of m against the matching block columns, so that disjoint ranges can run in parallel:
+static void am_fft_transpose_square(am_fft_complex_t *m, unsigned int n, unsigned int y_begin, unsigned int y_end)
 {
 #define am_fft_block_size 16
 	am_fft_complex_t block0[am_fft_block_size][am_fft_block_size];
@@ -271,7 +1941,7 @@ static void am_fft_transpose_square(am_fft_complex_t *m, unsigned int n)
 	
 	if (n <= am_fft_block_size)
 	{
-		for (unsigned int y = 0; y < n; y++)
+		for (unsigned int y = y_begin; y < y_end; y++)
 		{
 			for (unsigned int x = 0; x < y; x++)
 			{
@@ -286,7 +1956,7 @@ static void am_fft_transpose_square(am_fft_complex_t *m, unsigned int n)
 	}
 	else
 	{
-		for (unsigned int y = 0; y < n; y += am_fft_block_size)
+		for (unsigned int y = y_begin; y < y_end; y += am_fft_block_size)
 		{
 			for (unsigned int x = 0; x < y; x += am_fft_block_size)
 			{
@@ -342,29 +2012,678 @@ static void am_fft_transpose_square(am_fft_complex_t *m, unsigned int n)
 #undef am_fft_block_size
 }
 
-void am_fft_2d(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out)
+// Transposes the rows [y_begin, y_end) of in into the matching columns of out:
+static void am_fft_transpose_rect(const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int width, unsigned int height, unsigned int y_begin, unsigned int y_end)
 {
-	const am_fft_complex_t *ins[2];
-	am_fft_complex_t *outs[2];
-	am_fft_plan_1d_t *plans[2];
-	ins[0] =        in; outs[0] = plan->tmp; plans[0] = plan->x;
-	ins[1] = plan->tmp; outs[1] =       out; plans[1] = plan->y;
-	
-	for (unsigned int i = 0; i < 2; i++)
+#define am_fft_block_size 16
+	for (unsigned int y0 = y_begin; y0 < y_end; y0 += am_fft_block_size)
+	{
+		unsigned int y1 = y0 + am_fft_block_size < y_end ? y0 + am_fft_block_size : y_end;
+		for (unsigned int x0 = 0; x0 < width; x0 += am_fft_block_size)
+		{
+			unsigned int x1 = x0 + am_fft_block_size < width ? x0 + am_fft_block_size : width;
+			unsigned int y = y0;
+#ifndef AM_FFT_NO_SSE2
+			// 2x2 tiles, two rows of two complex values become two columns:
+			for (; y + 1 < y1; y += 2)
+			{
+				unsigned int x = x0;
+				for (; x + 1 < x1; x += 2)
+				{
+					__m128 row0 = _mm_loadu_ps(&in[y * width + x][0]);
+					__m128 row1 = _mm_loadu_ps(&in[(y + 1) * width + x][0]);
+					_mm_storeu_ps(&out[x * height + y][0], _mm_movelh_ps(row0, row1));
+					_mm_storeu_ps(&out[(x + 1) * height + y][0], _mm_movehl_ps(row1, row0));
+				}
+				for (; x < x1; x++)
+				{
+					out[x * height + y][0] = in[y * width + x][0];
+					out[x * height + y][1] = in[y * width + x][1];
+					out[x * height + y + 1][0] = in[(y + 1) * width + x][0];
+					out[x * height + y + 1][1] = in[(y + 1) * width + x][1];
+				}
+			}
+#endif
+			for (; y < y1; y++)
+			{
+				for (unsigned int x = x0; x < x1; x++)
+				{
+					out[x * height + y][0] = in[y * width + x][0];
+					out[x * height + y][1] = in[y * width + x][1];
+				}
+			}
+		}
+	}
+#undef am_fft_block_size
+}
+
+// A 2D dft runs as a sequence of passes, each split into independent tasks that either run in a loop or go to a scheduler.
+// tmp is either owned by the plan or supplied by the caller, like the scratch of serial runs. Parallel runs take the scratch of the running thread.
+#define AM_FFT_TASK_ROWS 16
+#define AM_FFT_MAX_THREADS 64
+
+typedef struct
+{
+	am_fft_complex_t *scratch;    // Serial runs only
+	const am_fft_plan_1d_t *plan; // Row or column dft of the pass
+	const am_fft_complex_t *in;
+	am_fft_complex_t *out;
+	const float *real_in;         // Real-to-complex row pass only
+	float *real_out;              // Complex-to-real row pass only
+	unsigned int width;           // Row length of in
+	unsigned int height;          // Row count of in
+	int threaded;
+	am_fft_load_row_t load;       // Row pass of am_fft_2d_load only, fills the rows in place of in
+	void *user;
+	unsigned int channels;        // Grids of width * height values back to back in in and out, all run by every task
+} am_fft_pass_t;
+
+// Per-thread scratch of the parallel passes, grown on demand and freed with the thread:
+struct am_fft_thread_scratch_t
+{
+	am_fft_complex_t *data;
+	unsigned int size;
+	~am_fft_thread_scratch_t()
 	{
-		unsigned int n = plans[i]->n;
+		if (data)
+			AM_FFT_FREE(data);
+	}
+};
 
-		for (unsigned int y = 0; y < n; y++)
-			am_fft_1d(plans[i], ins[i] + y * n, outs[i] + y * n);
+static am_fft_complex_t *am_fft_get_thread_scratch(unsigned int size)
+{
+	static thread_local am_fft_thread_scratch_t scratch = { 0, 0 };
+	if (scratch.size < size)
+	{
+		if (scratch.data)
+			AM_FFT_FREE(scratch.data);
+		scratch.data = (am_fft_complex_t*)AM_FFT_ALLOC(size * sizeof(am_fft_complex_t));
+		scratch.size = size;
+	}
+	return scratch.data;
+}
 
-		if (plans[0]->n == plans[1]->n)
+// Each task runs its rows, strip or blocks for every channel in turn, while the twiddles of the pass are still in cache:
+static void am_fft_rows_task(void *data, unsigned int index)
+{
+	const am_fft_pass_t *pass = (const am_fft_pass_t*)data;
+	unsigned int y_begin = index * AM_FFT_TASK_ROWS;
+	unsigned int y_end = y_begin + AM_FFT_TASK_ROWS < pass->height ? y_begin + AM_FFT_TASK_ROWS : pass->height;
+	unsigned int width = pass->width;
+	unsigned int cells = width * pass->height;
+	unsigned int scratch_count = pass->load ? (pass->channels + 1) * width : width;
+	am_fft_complex_t *scratch = pass->threaded ? am_fft_get_thread_scratch(scratch_count) : pass->scratch;
+	for (unsigned int y = y_begin; y < y_end; y++)
+	{
+		if (pass->load)
 		{
-            am_fft_transpose_square(outs[i], n);
+			// The loaded rows are still in cache when the dfts read them:
+			pass->load(pass->user, y, scratch + width);
+			for (unsigned int c = 0; c < pass->channels; c++)
+				am_fft_1d_scratch(pass->plan, scratch + (c + 1) * width, pass->out + c * cells + y * width, scratch);
 		}
 		else
 		{
-			// TODO: Transpose non-square matrices!
-			assert(0);
+			for (unsigned int c = 0; c < pass->channels; c++)
+				am_fft_1d_scratch(pass->plan, pass->in + c * cells + y * width, pass->out + c * cells + y * width, scratch);
+		}
+	}
+}
+
+static void am_fft_columns_task(void *data, unsigned int index)
+{
+	const am_fft_pass_t *pass = (const am_fft_pass_t*)data;
+	unsigned int x = index * AM_FFT_COLUMN_BATCH;
+	unsigned int count = x + AM_FFT_COLUMN_BATCH < pass->width ? AM_FFT_COLUMN_BATCH : pass->width - x;
+	unsigned int cells = pass->width * pass->height;
+	am_fft_complex_t *scratch = pass->threaded ? am_fft_get_thread_scratch(2 * AM_FFT_COLUMN_BATCH * pass->height) : pass->scratch;
+	for (unsigned int c = 0; c < pass->channels; c++)
+		am_fft_1d_columns(pass->plan, pass->in + c * cells + x, pass->out + c * cells + x, pass->width, count, scratch);
+}
+
+static void am_fft_transpose_square_task(void *data, unsigned int index)
+{
+	const am_fft_pass_t *pass = (const am_fft_pass_t*)data;
+	unsigned int y_begin = index * AM_FFT_TASK_ROWS;
+	unsigned int y_end = y_begin + AM_FFT_TASK_ROWS < pass->height ? y_begin + AM_FFT_TASK_ROWS : pass->height;
+	for (unsigned int c = 0; c < pass->channels; c++)
+		am_fft_transpose_square(pass->out + c * pass->width * pass->height, pass->width, y_begin, y_end);
+}
+
+static void am_fft_transpose_rect_task(void *data, unsigned int index)
+{
+	const am_fft_pass_t *pass = (const am_fft_pass_t*)data;
+	unsigned int y_begin = index * AM_FFT_TASK_ROWS;
+	unsigned int y_end = y_begin + AM_FFT_TASK_ROWS < pass->height ? y_begin + AM_FFT_TASK_ROWS : pass->height;
+	unsigned int cells = pass->width * pass->height;
+	for (unsigned int c = 0; c < pass->channels; c++)
+		am_fft_transpose_rect(pass->in + c * cells, pass->out + c * cells, pass->width, pass->height, y_begin, y_end);
+}
+
+// Real row dfts of real_in, each row of width real values leaves (width / 2 + 1) complex values in out:
+static void am_fft_r2c_rows_task(void *data, unsigned int index)
+{
+	const am_fft_pass_t *pass = (const am_fft_pass_t*)data;
+	const am_fft_plan_1d_t *plan = pass->plan;
+	unsigned int width = plan->n;
+	unsigned int y_begin = index * AM_FFT_TASK_ROWS;
+	unsigned int y_end = y_begin + AM_FFT_TASK_ROWS < pass->height ? y_begin + AM_FFT_TASK_ROWS : pass->height;
+	am_fft_complex_t *scratch = pass->threaded ? am_fft_get_thread_scratch(width / 2) : pass->scratch;
+	for (unsigned int y = y_begin; y < y_end; y++)
+		am_fft_1d_r2c_scratch(plan, pass->real_in + y * width, pass->out + y * pass->width, scratch);
+}
+
+// Complex-to-real row dfts of hermitian rows of (width / 2 + 1) complex values, leaving rows of width real values in real_out:
+static void am_fft_c2r_rows_task(void *data, unsigned int index)
+{
+	const am_fft_pass_t *pass = (const am_fft_pass_t*)data;
+	const am_fft_plan_1d_t *plan = pass->plan;
+	unsigned int width = plan->n;
+	unsigned int y_begin = index * AM_FFT_TASK_ROWS;
+	unsigned int y_end = y_begin + AM_FFT_TASK_ROWS < pass->height ? y_begin + AM_FFT_TASK_ROWS : pass->height;
+	am_fft_complex_t *scratch = pass->threaded ? am_fft_get_thread_scratch(width) : pass->scratch;
+	for (unsigned int y = y_begin; y < y_end; y++)
+		am_fft_1d_c2r_scratch(plan, pass->in + y * pass->width, pass->real_out + y * width, scratch);
+}
+
+static void am_fft_run_pass(am_fft_task_t task, am_fft_pass_t *pass, unsigned int count, am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	if (parallel_for)
+	{
+		pass->threaded = 1;
+		parallel_for(scheduler, task, pass, count);
+	}
+	else
+	{
+		pass->threaded = 0;
+		for (unsigned int i = 0; i < count; i++)
+			task(pass, i);
+	}
+}
+
+static void am_fft_run_rows(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int width, unsigned int height,
+                            am_fft_complex_t *scratch, am_fft_parallel_for_t parallel_for, void *scheduler, am_fft_load_row_t load, void *user,
+                            unsigned int channels)
+{
+	am_fft_pass_t pass = { scratch, plan, in, out, 0, 0, width, height, 0, load, user, channels };
+	am_fft_run_pass(am_fft_rows_task, &pass, (height + AM_FFT_TASK_ROWS - 1) / AM_FFT_TASK_ROWS, parallel_for, scheduler);
+}
+
+// With load the first row pass takes its rows from load and in is unused. in, out and tmp hold channels grids back to back:
+static void am_fft_2d_run(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *tmp, am_fft_complex_t *scratch,
+                          am_fft_parallel_for_t parallel_for, void *scheduler, am_fft_load_row_t load, void *user, unsigned int channels)
+{
+	unsigned int width = plan->width;
+	unsigned int height = plan->height;
+	unsigned int width_blocks = (width + AM_FFT_TASK_ROWS - 1) / AM_FFT_TASK_ROWS;
+	unsigned int height_blocks = (height + AM_FFT_TASK_ROWS - 1) / AM_FFT_TASK_ROWS;
+
+	// Rows into tmp, then the columns straight into out, a strip of AM_FFT_COLUMN_BATCH columns at a time.
+	// Every strip visits every row of the grid, which stops paying off once the grid outgrows the tlb and caches:
+	if (plan->columns)
+	{
+		am_fft_run_rows(plan->x, in, tmp, width, height, scratch, parallel_for, scheduler, load, user, channels);
+		am_fft_pass_t pass = { scratch, plan->y, tmp, out, 0, 0, width, height, 0, 0, 0, channels };
+		am_fft_run_pass(am_fft_columns_task, &pass, (width + AM_FFT_COLUMN_BATCH - 1) / AM_FFT_COLUMN_BATCH, parallel_for, scheduler);
+		return;
+	}
+
+	// The in-place square transpose works on whole 16x16 blocks:
+	if (width == height && width % 16 == 0)
+	{
+		am_fft_pass_t pass = { scratch, 0, 0, tmp, 0, 0, width, height, 0, 0, 0, channels };
+		am_fft_run_rows(plan->x, in, tmp, width, height, scratch, parallel_for, scheduler, load, user, channels);
+		am_fft_run_pass(am_fft_transpose_square_task, &pass, height_blocks, parallel_for, scheduler);
+		am_fft_run_rows(plan->y, tmp, out, height, width, scratch, parallel_for, scheduler, 0, 0, channels);
+		pass.out = out;
+		am_fft_run_pass(am_fft_transpose_square_task, &pass, height_blocks, parallel_for, scheduler);
+		return;
+	}
+
+	// Rectangular: rows into tmp, transpose into out, columns (now rows of out) into tmp, transpose back into out:
+	am_fft_run_rows(plan->x, in, tmp, width, height, scratch, parallel_for, scheduler, load, user, channels);
+	am_fft_pass_t pass = { scratch, 0, tmp, out, 0, 0, width, height, 0, 0, 0, channels };
+	am_fft_run_pass(am_fft_transpose_rect_task, &pass, height_blocks, parallel_for, scheduler);
+	am_fft_run_rows(plan->y, out, tmp, height, width, scratch, parallel_for, scheduler, 0, 0, channels);
+	pass.width = height;
+	pass.height = width;
+	am_fft_run_pass(am_fft_transpose_rect_task, &pass, width_blocks, parallel_for, scheduler);
+}
+
+static void am_fft_2d_c2r_run(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out, am_fft_complex_t *tmp, am_fft_complex_t *scratch,
+                              am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	unsigned int height = plan->height;
+	unsigned int columns = plan->width / 2 + 1;
+
+	// Complex dfts down the columns, the rows stay hermitian:
+	am_fft_pass_t pass = { scratch, plan->y, in, tmp, 0, 0, columns, height, 0, 0, 0, 1 };
+	am_fft_run_pass(am_fft_columns_task, &pass, (columns + AM_FFT_COLUMN_BATCH - 1) / AM_FFT_COLUMN_BATCH, parallel_for, scheduler);
+
+	pass.plan = plan->x;
+	pass.in = tmp;
+	pass.real_out = out;
+	am_fft_run_pass(am_fft_c2r_rows_task, &pass, (height + AM_FFT_TASK_ROWS - 1) / AM_FFT_TASK_ROWS, parallel_for, scheduler);
+}
+
+static void am_fft_2d_r2c_run(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out, am_fft_complex_t *tmp, am_fft_complex_t *scratch,
+                              am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	unsigned int height = plan->height;
+	unsigned int columns = plan->width / 2 + 1;
+
+	// Real dfts along the rows into tmp, then complex dfts down the non-redundant columns:
+	am_fft_pass_t pass = { scratch, plan->x, 0, tmp, 0, 0, columns, height, 0, 0, 0, 1 };
+	pass.real_in = in;
+	am_fft_run_pass(am_fft_r2c_rows_task, &pass, (height + AM_FFT_TASK_ROWS - 1) / AM_FFT_TASK_ROWS, parallel_for, scheduler);
+
+	pass.plan = plan->y;
+	pass.in = tmp;
+	pass.out = out;
+	am_fft_run_pass(am_fft_columns_task, &pass, (columns + AM_FFT_COLUMN_BATCH - 1) / AM_FFT_COLUMN_BATCH, parallel_for, scheduler);
+}
+
+// Times column strips against transposes for the grid of plan, records the faster and leaves it in the plan:
+static void am_fft_measure_2d(am_fft_plan_2d_t *plan)
+{
+	unsigned int cells = plan->width * plan->height;
+	unsigned int tmp_count = am_fft_2d_tmp_count(plan);
+	am_fft_complex_t *buffers = (am_fft_complex_t*)AM_FFT_ALLOC((2 * cells + am_fft_2d_scratch_size(plan)) * sizeof(am_fft_complex_t));
+	for (unsigned int i = 0; i < 2 * cells; i++)
+	{
+		buffers[i][0] = (float)(i % 7) - 3.0f;
+		buffers[i][1] = (float)(i % 5) - 2.0f;
+	}
+	am_fft_complex_t *tmp = buffers + 2 * cells;
+	unsigned int repeats = cells < AM_FFT_MEASURE_WORK ? AM_FFT_MEASURE_WORK / cells : 1;
+	am_fft_wisdom_t wisdom = { 2, plan->width, plan->height, 1, 0, 0 };
+	double best = -1.0;
+	for (int columns = 1; columns >= 0; columns--)
+	{
+		plan->columns = columns;
+		for (int run = 0; run < AM_FFT_MEASURE_RUNS; run++)
+		{
+			double start = am_fft_seconds();
+			for (unsigned int i = 0; i < repeats; i++)
+				am_fft_2d_run(plan, buffers, buffers + cells, tmp, tmp + tmp_count, 0, 0, 0, 0, 1);
+			double seconds = am_fft_seconds() - start;
+			if (best < 0.0 || seconds < best)
+			{
+				best = seconds;
+				wisdom.engine = columns;
+			}
+		}
+	}
+	AM_FFT_FREE(buffers);
+	plan->columns = wisdom.engine;
+	am_fft_wisdom_record(&wisdom);
+}
+
+// Scheduler of am_fft_2d_threaded, scheduler points at the thread count:
+static void am_fft_thread_parallel_for(void *scheduler, am_fft_task_t task, void *data, unsigned int count)
+{
+	unsigned int thread_count = *(const unsigned int*)scheduler;
+	if (thread_count > AM_FFT_MAX_THREADS)
+		thread_count = AM_FFT_MAX_THREADS;
+	if (thread_count > count)
+		thread_count = count;
+
+	std::atomic<unsigned int> next(0);
+	auto work = [&]()
+	{
+		for (unsigned int i = next++; i < count; i = next++)
+			task(data, i);
+	};
+	std::thread threads[AM_FFT_MAX_THREADS];
+	for (unsigned int i = 1; i < thread_count; i++)
+		threads[i] = std::thread(work);
+	work();
+	for (unsigned int i = 1; i < thread_count; i++)
+		threads[i].join();
+}
+
+// Caller scratch holds tmp followed by the scratch of the serial passes:
+static am_fft_complex_t *am_fft_2d_split_scratch(const am_fft_plan_2d_t *plan, am_fft_complex_t *scratch)
+{
+	return scratch + am_fft_2d_tmp_count(plan);
+}
+
+void am_fft_2d(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out)
+{
+	am_fft_2d_run(plan, in, out, plan->tmp, plan->scratch, 0, 0, 0, 0, 1);
+}
+
+void am_fft_2d_parallel(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_run(plan, in, out, plan->tmp, plan->scratch, parallel_for, scheduler, 0, 0, 1);
+}
+
+void am_fft_2d_threaded(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int thread_count)
+{
+	if (thread_count <= 1)
+		am_fft_2d_run(plan, in, out, plan->tmp, plan->scratch, 0, 0, 0, 0, 1);
+	else
+		am_fft_2d_run(plan, in, out, plan->tmp, plan->scratch, am_fft_thread_parallel_for, &thread_count, 0, 0, 1);
+}
+
+void am_fft_2d_load(const am_fft_plan_2d_t *plan, am_fft_load_row_t load, void *user, am_fft_complex_t *out)
+{
+	am_fft_2d_run(plan, 0, out, plan->tmp, plan->scratch, 0, 0, load, user, 1);
+}
+
+void am_fft_2d_load_parallel(const am_fft_plan_2d_t *plan, am_fft_load_row_t load, void *user, am_fft_complex_t *out,
+                             am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_run(plan, 0, out, plan->tmp, plan->scratch, parallel_for, scheduler, load, user, 1);
+}
+
+void am_fft_2d_c2r(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out)
+{
+	am_fft_2d_c2r_run(plan, in, out, plan->tmp, plan->scratch, 0, 0);
+}
+
+void am_fft_2d_c2r_parallel(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out, am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_c2r_run(plan, in, out, plan->tmp, plan->scratch, parallel_for, scheduler);
+}
+
+void am_fft_2d_r2c(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out)
+{
+	am_fft_2d_r2c_run(plan, in, out, plan->tmp, plan->scratch, 0, 0);
+}
+
+void am_fft_2d_r2c_parallel(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out, am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_r2c_run(plan, in, out, plan->tmp, plan->scratch, parallel_for, scheduler);
+}
+
+void am_fft_2d_scratch(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch,
+                       am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_run(plan, in, out, scratch, am_fft_2d_split_scratch(plan, scratch), parallel_for, scheduler, 0, 0, 1);
+}
+
+void am_fft_2d_batch_scratch(const am_fft_plan_2d_t *plan, unsigned int count, const am_fft_complex_t *in, am_fft_complex_t *out,
+                             am_fft_complex_t *scratch, am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_run(plan, in, out, scratch, scratch + count * am_fft_2d_tmp_count(plan), parallel_for, scheduler, 0, 0, count);
+}
+
+void am_fft_2d_batch_load_scratch(const am_fft_plan_2d_t *plan, unsigned int count, am_fft_load_row_t load, void *user, am_fft_complex_t *out,
+                                  am_fft_complex_t *scratch, am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_run(plan, 0, out, scratch, scratch + count * am_fft_2d_tmp_count(plan), parallel_for, scheduler, load, user, count);
+}
+
+void am_fft_2d_r2c_scratch(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out, am_fft_complex_t *scratch,
+                           am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_r2c_run(plan, in, out, scratch, am_fft_2d_split_scratch(plan, scratch), parallel_for, scheduler);
+}
+
+void am_fft_2d_c2r_scratch(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out, am_fft_complex_t *scratch,
+                           am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	am_fft_2d_c2r_run(plan, in, out, scratch, am_fft_2d_split_scratch(plan, scratch), parallel_for, scheduler);
+}
+
+#ifndef AM_FFT_NO_FILES
+// A file of complex values mapped one window at a time, so only the window in use is resident:
+typedef struct
+{
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+	int writable;
+} am_fft_file_t;
+
+typedef struct
+{
+	void *base;
+	size_t size;
+	am_fft_complex_t *data;
+} am_fft_view_t;
+
+// Opens path for reading, or creates it with size bytes (reserved on disk where the platform allows) for writing:
+static int am_fft_file_open(am_fft_file_t *file, const char *path, int writable, size_t size)
+{
+	file->writable = writable;
+#ifdef _WIN32
+	file->file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+	                         writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file->file == INVALID_HANDLE_VALUE)
+		return 0;
+	// Resizing fails while in_path == out_path is mapped for reading, so only resize files of the wrong size:
+	LARGE_INTEGER file_size;
+	int ok = GetFileSizeEx(file->file, &file_size);
+	if (ok && writable && (unsigned long long)file_size.QuadPart != size)
+	{
+		file_size.QuadPart = (LONGLONG)size;
+		ok = SetFilePointerEx(file->file, file_size, 0, FILE_BEGIN) && SetEndOfFile(file->file);
+	}
+	else if (ok && !writable)
+	{
+		ok = (unsigned long long)file_size.QuadPart >= size;
+	}
+	file->mapping = ok ? CreateFileMappingA(file->file, 0, writable ? PAGE_READWRITE : PAGE_READONLY,
+	                                        (DWORD)((unsigned long long)size >> 32), (DWORD)size, 0) : 0;
+	if (!file->mapping)
+	{
+		CloseHandle(file->file);
+		return 0;
+	}
+	return 1;
+#else
+	file->file = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (file->file < 0)
+		return 0;
+	struct stat status;
+	int ok;
+	if (writable)
+	{
+		// Mapped writes past the free disk space would fault, so claim the blocks now and fail here instead:
+#ifdef __linux__
+		ok = ftruncate(file->file, (off_t)size) == 0 && posix_fallocate(file->file, 0, (off_t)size) == 0;
+#else
+		ok = ftruncate(file->file, (off_t)size) == 0;
+#endif
+	}
+	else
+	{
+		ok = fstat(file->file, &status) == 0 && (size_t)status.st_size >= size;
+	}
+	if (!ok)
+		close(file->file);
+	return ok;
+#endif
+}
+
+static void am_fft_file_close(am_fft_file_t *file)
+{
+#ifdef _WIN32
+	CloseHandle(file->mapping);
+	CloseHandle(file->file);
+#else
+	close(file->file);
+#endif
+}
+
+// Maps size bytes from offset, which needs no alignment:
+static int am_fft_view_map(const am_fft_file_t *file, size_t offset, size_t size, am_fft_view_t *view)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t granularity = info.dwAllocationGranularity;
+#else
+	size_t granularity = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	size_t start = offset - offset % granularity;
+	view->size = offset - start + size;
+#ifdef _WIN32
+	view->base = MapViewOfFile(file->mapping, file->writable ? FILE_MAP_WRITE : FILE_MAP_READ, (DWORD)((unsigned long long)start >> 32), (DWORD)start, view->size);
+#else
+	view->base = mmap(0, view->size, file->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file->file, (off_t)start);
+	if (view->base == MAP_FAILED)
+		view->base = 0;
+	else
+		posix_madvise(view->base, view->size, POSIX_MADV_SEQUENTIAL);
+#endif
+	view->data = view->base ? (am_fft_complex_t*)((char*)view->base + (offset - start)) : 0;
+	return view->base != 0;
+}
+
+static void am_fft_view_unmap(am_fft_view_t *view)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(view->base);
+#else
+	munmap(view->base, view->size);
+#endif
+}
+
+int am_fft_2d_file(const am_fft_plan_2d_t *plan, const char *in_path, const char *out_path, const char *scratch_path, size_t memory_budget,
+                   am_fft_parallel_for_t parallel_for, void *scheduler)
+{
+	unsigned int width = plan->width;
+	unsigned int height = plan->height;
+	size_t value_bytes = sizeof(am_fft_complex_t);
+	size_t row_bytes = width * value_bytes;
+	size_t bytes = row_bytes * height;
+
+	// A row slab holds its input view, the transformed rows and the scratch views they go to, a column slab its scratch view and
+	// the transformed columns:
+	size_t rows = memory_budget / (3 * row_bytes);
+	rows = rows < 1 ? 1 : rows > height ? height : rows;
+	size_t columns = memory_budget / (2 * height * value_bytes);
+	columns -= columns % AM_FFT_COLUMN_BATCH;
+	columns = columns < AM_FFT_COLUMN_BATCH ? AM_FFT_COLUMN_BATCH : columns;
+	columns = columns > width ? width : columns;
+
+	size_t buffer_count = rows * width > height * columns ? rows * width : height * columns;
+	size_t scratch_count = am_fft_2d_serial_scratch_count(width, height, 1);
+	am_fft_complex_t *buffer = (am_fft_complex_t*)AM_FFT_ALLOC((buffer_count + scratch_count) * value_bytes);
+	if (!buffer)
+		return 0;
+	am_fft_complex_t *scratch = buffer + buffer_count;
+
+	am_fft_file_t in_file, out_file, scratch_file;
+	int ok = am_fft_file_open(&in_file, in_path, 0, bytes);
+	if (ok && !am_fft_file_open(&scratch_file, scratch_path, 1, bytes))
+	{
+		am_fft_file_close(&in_file);
+		ok = 0;
+	}
+	if (ok && !am_fft_file_open(&out_file, out_path, 1, bytes))
+	{
+		am_fft_file_close(&in_file);
+		am_fft_file_close(&scratch_file);
+		remove(scratch_path);
+		ok = 0;
+	}
+	if (!ok)
+	{
+		AM_FFT_FREE(buffer);
+		return 0;
+	}
+
+	// The scratch file holds column slabs of columns values per row one after the other (the last one may be narrower),
+	// so each pass below reads and writes it in runs of a whole slab or a whole block of rows of one slab:
+	am_fft_view_t view;
+	for (size_t y = 0; ok && y < height; y += rows)
+	{
+		size_t count = height - y < rows ? height - y : rows;
+		ok = am_fft_view_map(&in_file, y * row_bytes, count * row_bytes, &view);
+		if (!ok)
+			break;
+		am_fft_run_rows(plan->x, view.data, buffer, width, (unsigned int)count, scratch, parallel_for, scheduler, 0, 0, 1);
+		am_fft_view_unmap(&view);
+
+		for (size_t x = 0; ok && x < width; x += columns)
+		{
+			size_t slab_width = width - x < columns ? width - x : columns;
+			ok = am_fft_view_map(&scratch_file, (x * height + y * slab_width) * value_bytes, count * slab_width * value_bytes, &view);
+			if (!ok)
+				break;
+			for (size_t i = 0; i < count; i++)
+				memcpy(view.data + i * slab_width, buffer + i * width + x, slab_width * value_bytes);
+			am_fft_view_unmap(&view);
+		}
+	}
+
+	for (size_t x = 0; ok && x < width; x += columns)
+	{
+		size_t slab_width = width - x < columns ? width - x : columns;
+		ok = am_fft_view_map(&scratch_file, x * height * value_bytes, height * slab_width * value_bytes, &view);
+		if (!ok)
+			break;
+		am_fft_pass_t pass = { scratch, plan->y, view.data, buffer, 0, 0, (unsigned int)slab_width, height, 0, 0, 0, 1 };
+		am_fft_run_pass(am_fft_columns_task, &pass, (unsigned int)((slab_width + AM_FFT_COLUMN_BATCH - 1) / AM_FFT_COLUMN_BATCH), parallel_for, scheduler);
+		memcpy(view.data, buffer, height * slab_width * value_bytes);
+		am_fft_view_unmap(&view);
+	}
+
+	for (size_t y = 0; ok && y < height; y += rows)
+	{
+		size_t count = height - y < rows ? height - y : rows;
+		am_fft_view_t out_view;
+		ok = am_fft_view_map(&out_file, y * row_bytes, count * row_bytes, &out_view);
+		for (size_t x = 0; ok && x < width; x += columns)
+		{
+			size_t slab_width = width - x < columns ? width - x : columns;
+			ok = am_fft_view_map(&scratch_file, (x * height + y * slab_width) * value_bytes, count * slab_width * value_bytes, &view);
+			if (!ok)
+				break;
+			for (size_t i = 0; i < count; i++)
+				memcpy(out_view.data + i * width + x, view.data + i * slab_width, slab_width * value_bytes);
+			am_fft_view_unmap(&view);
 		}
+		if (out_view.base)
+			am_fft_view_unmap(&out_view);
+	}
+
+	am_fft_file_close(&in_file);
+	am_fft_file_close(&out_file);
+	am_fft_file_close(&scratch_file);
+	remove(scratch_path);
+	AM_FFT_FREE(buffer);
+	return ok;
+}
+#endif
+
+// One line per entry: dimensions width height engine simd, with height 1 for 1D sizes.
+int am_fft_wisdom_save(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+		return 0;
+	std::lock_guard<std::mutex> lock(am_fft_wisdom_mutex);
+	int ok = fprintf(file, "am_fft_wisdom %d\n", AM_FFT_WISDOM_VERSION) > 0;
+	for (am_fft_wisdom_t *entry = am_fft_wisdom_list; entry && ok; entry = entry->next)
+		ok = fprintf(file, "%d %u %u %d %d\n", entry->dimensions, entry->width, entry->height, entry->engine, entry->simd) > 0;
+	return fclose(file) == 0 && ok;
+}
+
+int am_fft_wisdom_load(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return 0;
+	int version = 0;
+	int ok = fscanf(file, "am_fft_wisdom %d", &version) == 1 && version == AM_FFT_WISDOM_VERSION;
+	am_fft_wisdom_t wisdom;
+	while (ok && fscanf(file, "%d %u %u %d %d", &wisdom.dimensions, &wisdom.width, &wisdom.height, &wisdom.engine, &wisdom.simd) == 5)
+	{
+		int valid_1d = wisdom.dimensions == 1 && wisdom.height == 1 && wisdom.engine >= 0 && wisdom.engine <= AM_FFT_ENGINE_FOUR_STEP &&
+			wisdom.engine != AM_FFT_ENGINE_REAL && wisdom.simd >= 0 && wisdom.simd <= AM_FFT_SIMD_AVX512;
+		int valid_2d = wisdom.dimensions == 2 && (wisdom.engine == 0 || wisdom.engine == 1) && wisdom.simd == 0;
+		if (!valid_1d && !valid_2d)
+			continue;
+		am_fft_wisdom_record(&wisdom);
 	}
+	fclose(file);
+	return ok;
 }
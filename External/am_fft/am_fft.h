@@ -27,8 +27,22 @@ SOFTWARE.
 #ifndef AM_FFT_H
 #define AM_FFT_H
 
+#include <stddef.h>
 
-// NOTE: This library is currently limited to FFTs with power-of-two sizes and, in case of 2D dfts, a square shape.
+// NOTE: This library is currently limited to FFTs whose sizes factor into 2, 3 and 5 (for example 384, 768 or 960).
+// 2D dfts may be rectangular, width and height are planned independently. Below AM_FFT_COLUMNS_MAX_CELLS (1024 * 1024) cells
+// the second dimension runs through am_fft_1d_columns, larger grids are transposed around a second pass of row dfts
+// (unless wisdom says otherwise, see AM_FFT_MEASURE).
+
+// The butterfly passes use SSE2, AVX2+FMA or AVX-512, picked per plan from cpuid. Compile am_fft.cpp with
+// AM_FFT_NO_SSE2, AM_FFT_NO_AVX2 or AM_FFT_NO_AVX512 to leave out a path and everything wider.
+// Powers of two from AM_FFT_STOCKHAM_MIN_N (16) up and all other sizes run a stockham engine with radix-2/3/4/5/8 stages,
+// small powers of two the radix-2 passes. The ocean cascade sizes 64, 128, 256 and 512 run stockham kernels unrolled at compile time.
+// Long sizes can also run a four-step engine, n1 * n2 split into sub-dfts of about
+// sqrt(n) values between tiled transposes, picked by AM_FFT_MEASURE or from AM_FFT_FOUR_STEP_MIN_N up.
+// Planning returns 0 for sizes with other prime factors.
+// In and out of 1D dfts must not overlap, 2D dfts may also run in place (in == out).
+// Plans of the same size and direction share one refcounted set of twiddles.
 
 
 // The complex type { real, imaginary }:
@@ -42,13 +56,106 @@ typedef struct am_fft_plan_2d_ am_fft_plan_2d_t;
 #define AM_FFT_FORWARD 0
 #define AM_FFT_INVERSE 1
 
+// Plan flags, or'ed into the direction. AM_FFT_NO_SCRATCH plans hold no work buffers and only run the *_scratch functions,
+// so one plan can run any number of dfts at the same time.
+// AM_FFT_MEASURE plans time the candidate kernels of sizes without wisdom on this machine and record the fastest:
+// the engine and instruction set of 1D sizes and column strips or transposes for complex 2D grids. Every plan uses
+// existing wisdom, measuring or not.
+#define AM_FFT_NO_SCRATCH 0x10
+#define AM_FFT_MEASURE 0x20
+
+// Wisdom lives for the process. Save it to skip the measurements in later processes on the same machine, both return 1 on success:
+int               am_fft_wisdom_save(const char *path);
+int               am_fft_wisdom_load(const char *path);
+
 // Functions:
 am_fft_plan_1d_t* am_fft_plan_1d(int direction, unsigned int n);
 void              am_fft_plan_1d_free(am_fft_plan_1d_t *plan);
 void              am_fft_1d(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out);
 
+// Same with scratch of n complex values from the caller:
+void              am_fft_1d_scratch(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch);
+
+// Transforms count columns of stride complex values at once, column c holds in[i * stride + c] for i < n.
+// Strips of AM_FFT_COLUMN_BATCH neighbouring columns are transformed together, one column per SIMD lane, so nothing gets transposed.
+// scratch must hold 2 * n * AM_FFT_COLUMN_BATCH complex values, in and out must not overlap.
+#define AM_FFT_COLUMN_BATCH 16
+void              am_fft_1d_columns(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int stride, unsigned int count,
+                                    am_fft_complex_t *scratch);
+
+// Real-to-complex and complex-to-real 1D dfts of even length n, computed by an (n / 2)-point complex dft plus a twiddle pass.
+// The complex side holds the n / 2 + 1 non-redundant bins of the hermitian spectrum, the remaining ones are conj(X[n - k]).
+// Both run in the direction of the plan and are unnormalized like am_fft_1d. Real plans only work with these functions,
+// the *_scratch variants take n / 2 (r2c) or n (c2r) complex values of scratch.
+am_fft_plan_1d_t* am_fft_plan_1d_r2c(int direction, unsigned int n);
+am_fft_plan_1d_t* am_fft_plan_1d_c2r(int direction, unsigned int n);
+void              am_fft_1d_r2c(const am_fft_plan_1d_t *plan, const float *in, am_fft_complex_t *out);
+void              am_fft_1d_c2r(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, float *out);
+void              am_fft_1d_r2c_scratch(const am_fft_plan_1d_t *plan, const float *in, am_fft_complex_t *out, am_fft_complex_t *scratch);
+void              am_fft_1d_c2r_scratch(const am_fft_plan_1d_t *plan, const am_fft_complex_t *in, float *out, am_fft_complex_t *scratch);
+
 am_fft_plan_2d_t* am_fft_plan_2d(int direction, unsigned int width, unsigned int height);
 void              am_fft_plan_2d_free(am_fft_plan_2d_t *plan);
 void              am_fft_2d(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out);
 
+// Parallel 2D dfts. parallel_for must run task(data, i) for every i < count, in any order and on any threads, and return once
+// all of them are done. Each pass of the dft (row dfts, column strips, transposes) is one parallel_for over independent tasks.
+// A plan may only run one dft at a time through its own buffers, see the *_scratch functions below.
+typedef void (*am_fft_task_t)(void *data, unsigned int index);
+typedef void (*am_fft_parallel_for_t)(void *scheduler, am_fft_task_t task, void *data, unsigned int count);
+void              am_fft_2d_parallel(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out,
+                                     am_fft_parallel_for_t parallel_for, void *scheduler);
+
+// Same on thread_count threads including the calling one, started for each pass:
+void              am_fft_2d_threaded(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, unsigned int thread_count);
+
+// Complex 2D dfts whose input comes from load instead of an array. load(user, y, row) writes the width values of row y and runs
+// once per row right before its row dft, on any thread with parallel_for, so the input is never stored as a whole grid.
+typedef void (*am_fft_load_row_t)(void *user, unsigned int y, am_fft_complex_t *row);
+void              am_fft_2d_load(const am_fft_plan_2d_t *plan, am_fft_load_row_t load, void *user, am_fft_complex_t *out);
+void              am_fft_2d_load_parallel(const am_fft_plan_2d_t *plan, am_fft_load_row_t load, void *user, am_fft_complex_t *out,
+                                          am_fft_parallel_for_t parallel_for, void *scheduler);
+
+// Real-to-complex and complex-to-real 2D dfts. The real side holds height rows of width real values, the complex side
+// height rows of the (width / 2 + 1) non-redundant columns of the hermitian spectrum. Free with am_fft_plan_2d_free.
+am_fft_plan_2d_t* am_fft_plan_2d_r2c(int direction, unsigned int width, unsigned int height);
+void              am_fft_2d_r2c(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out);
+void              am_fft_2d_r2c_parallel(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out,
+                                         am_fft_parallel_for_t parallel_for, void *scheduler);
+
+am_fft_plan_2d_t* am_fft_plan_2d_c2r(int direction, unsigned int width, unsigned int height);
+void              am_fft_2d_c2r(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out);
+void              am_fft_2d_c2r_parallel(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out,
+                                         am_fft_parallel_for_t parallel_for, void *scheduler);
+
+// 2D dfts with the work buffers supplied by the caller, am_fft_2d_scratch_size(plan) complex values per running dft.
+// parallel_for may be 0 to run on the calling thread.
+unsigned int      am_fft_2d_scratch_size(const am_fft_plan_2d_t *plan);
+void              am_fft_2d_scratch(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, am_fft_complex_t *out, am_fft_complex_t *scratch,
+                                    am_fft_parallel_for_t parallel_for, void *scheduler);
+void              am_fft_2d_r2c_scratch(const am_fft_plan_2d_t *plan, const float *in, am_fft_complex_t *out, am_fft_complex_t *scratch,
+                                        am_fft_parallel_for_t parallel_for, void *scheduler);
+void              am_fft_2d_c2r_scratch(const am_fft_plan_2d_t *plan, const am_fft_complex_t *in, float *out, am_fft_complex_t *scratch,
+                                        am_fft_parallel_for_t parallel_for, void *scheduler);
+
+// Batched complex 2D dfts of count grids of width * height values, stored back to back in in and out. Every pass runs all grids
+// in the same parallel_for and each task goes through its rows or columns grid after grid, so they share the twiddles in cache.
+// The load variant's load(user, y, rows) writes row y of every grid, grid c at rows + c * width.
+// scratch holds am_fft_2d_batch_scratch_size(plan, count) complex values.
+unsigned int      am_fft_2d_batch_scratch_size(const am_fft_plan_2d_t *plan, unsigned int count);
+void              am_fft_2d_batch_scratch(const am_fft_plan_2d_t *plan, unsigned int count, const am_fft_complex_t *in, am_fft_complex_t *out,
+                                          am_fft_complex_t *scratch, am_fft_parallel_for_t parallel_for, void *scheduler);
+void              am_fft_2d_batch_load_scratch(const am_fft_plan_2d_t *plan, unsigned int count, am_fft_load_row_t load, void *user,
+                                               am_fft_complex_t *out, am_fft_complex_t *scratch, am_fft_parallel_for_t parallel_for, void *scheduler);
+
+// Out-of-core complex 2D dfts of grids that do not fit in memory, such as 16384 x 16384 (2 GB per grid). in_path holds height rows
+// of width complex values with no header, out_path receives the result in the same layout and may be in_path.
+// The files are memory mapped one slab at a time: row dfts of row slabs into scratch_path, which is laid out in column slabs so the
+// column dfts read and write each slab in one piece, then a copy of row slabs into out_path. Mapped views and buffers stay within
+// about memory_budget bytes, but always take at least one row and AM_FFT_COLUMN_BATCH columns. scratch_path is created as large
+// as the grid and deleted again. Plan with AM_FFT_NO_SCRATCH and without AM_FFT_MEASURE, so the plan holds no grid of its own.
+// Returns 1 on success, 0 when a file could not be opened, sized or mapped. Compile am_fft.cpp with AM_FFT_NO_FILES to leave it out.
+int               am_fft_2d_file(const am_fft_plan_2d_t *plan, const char *in_path, const char *out_path, const char *scratch_path,
+                                 size_t memory_budget, am_fft_parallel_for_t parallel_for, void *scheduler);
+
 #endif
\ No newline at end of file
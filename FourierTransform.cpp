@@ -1,14 +1,10 @@
 #include "FourierTransform.h"
 #include "OceanDefine.h"
 
+#include <cassert>
+
 #define USE_FFT_V2 0
 
-struct FFTParam {
-    int size;
-    int pass;
-    int ping_pong;
-    int is_horizontal;
-};
 
 int BitReverse(int i, int size) {
     int j = i;
@@ -25,30 +21,42 @@ int BitReverse(int i, int size) {
     return sum;
 }
 
-FourierTransform::FourierTransform(Context* in_context, int in_size) {
+FourierTransform::FourierTransform(Context* in_context, int in_size, bool in_real_output, int in_max_count) {
     size = in_size;
     context = in_context;
+    real_output = in_real_output;
+    max_count = in_max_count;
     passes = (int)(log(size) / log(2));
 
     blast::GfxDevice* device = context->device;
     blast::GfxTextureDesc texture_desc;
-    texture_desc.width = size;
+    texture_desc.width = real_output ? size / 2 : size;
     texture_desc.height = size;
     texture_desc.format = blast::FORMAT_R32G32_FLOAT;
     texture_desc.mem_usage = blast::MEMORY_USAGE_GPU_ONLY;
     texture_desc.res_usage = blast::RESOURCE_USAGE_SHADER_RESOURCE | blast::RESOURCE_USAGE_UNORDERED_ACCESS;
-    pass_texture0 = device->CreateTexture(texture_desc);
-    pass_texture1 = device->CreateTexture(texture_desc);
+    for (int i = 0; i < max_count; i++) {
+        pass_textures0.push_back(device->CreateTexture(texture_desc));
+        pass_textures1.push_back(device->CreateTexture(texture_desc));
+    }
+
+    butterfly_lookup_table = CreateButterflyLookupTable(size, passes);
+    if (real_output) {
+        half_butterfly_lookup_table = CreateButterflyLookupTable(size / 2, passes - 1);
+    }
+}
 
+blast::GfxBuffer* FourierTransform::CreateButterflyLookupTable(int n, int n_passes) {
+    blast::GfxDevice* device = context->device;
     blast::GfxBufferDesc buffer_desc = {};
-    buffer_desc.size = sizeof(LookUp) * size * passes;
+    buffer_desc.size = sizeof(LookUp) * n * n_passes;
     buffer_desc.mem_usage = blast::MEMORY_USAGE_GPU_ONLY;
     buffer_desc.res_usage = blast::RESOURCE_USAGE_RW_BUFFER;
-    butterfly_lookup_table = device->CreateBuffer(buffer_desc);
+    blast::GfxBuffer* lookup_table = device->CreateBuffer(buffer_desc);
 
-    LookUp* butterfly_lookup_table_data = new LookUp[size * passes];
-    for (int i = 0; i < passes; i++) {
-        int blocks = (int)pow(2, passes - 1 - i);
+    LookUp* butterfly_lookup_table_data = new LookUp[n * n_passes];
+    for (int i = 0; i < n_passes; i++) {
+        int blocks = (int)pow(2, n_passes - 1 - i);
         int inputs = (int)pow(2, i);
 
         for (int j = 0; j < blocks; j++){
@@ -57,8 +65,8 @@ FourierTransform::FourierTransform(Context* in_context, int in_size) {
                 if (i == 0) {
                     i1 = j * inputs * 2 + k;
                     i2 = j * inputs * 2 + inputs + k;
-                    j1 = BitReverse(i1, size);
-                    j2 = BitReverse(i2, size);
+                    j1 = BitReverse(i1, n);
+                    j2 = BitReverse(i2, n);
                 } else {
                     i1 = j * inputs * 2 + k;
                     i2 = j * inputs * 2 + inputs + k;
@@ -66,16 +74,16 @@ FourierTransform::FourierTransform(Context* in_context, int in_size) {
                     j2 = i2;
                 }
 
-                float wr = cos(2.0f * PI * (float)(k * blocks) / size);
-                float wi = -sin(2.0f * PI * (float)(k * blocks) / size);
+                float wr = cos(2.0f * PI * (float)(k * blocks) / n);
+                float wi = -sin(2.0f * PI * (float)(k * blocks) / n);
 
-                int offset1 = (i1 + i * size);
+                int offset1 = (i1 + i * n);
                 butterfly_lookup_table_data[offset1].j1 = j1;
                 butterfly_lookup_table_data[offset1].j2 = j2;
                 butterfly_lookup_table_data[offset1].wr = wr;
                 butterfly_lookup_table_data[offset1].wi = wi;
 
-                int offset2 = (i2 + i * size);
+                int offset2 = (i2 + i * n);
                 butterfly_lookup_table_data[offset2].j1 = j1;
                 butterfly_lookup_table_data[offset2].j2 = j2;
                 butterfly_lookup_table_data[offset2].wr = -wr;
@@ -85,44 +93,61 @@ FourierTransform::FourierTransform(Context* in_context, int in_size) {
     }
 
     blast::GfxCommandBuffer* copy_cmd = device->RequestCommandBuffer(blast::QUEUE_COPY);
-    device->UpdateBuffer(copy_cmd, butterfly_lookup_table, butterfly_lookup_table_data, sizeof(LookUp) * size * passes);
+    device->UpdateBuffer(copy_cmd, lookup_table, butterfly_lookup_table_data, sizeof(LookUp) * n * n_passes);
     blast::GfxBufferBarrier barrier;
-    barrier.buffer = butterfly_lookup_table;
+    barrier.buffer = lookup_table;
     barrier.new_state = blast::RESOURCE_STATE_SHADER_RESOURCE | blast::RESOURCE_STATE_UNORDERED_ACCESS;
     device->SetBarrier(copy_cmd, 1, &barrier, 0, nullptr);
 
     SAFE_DELETE_ARRAY(butterfly_lookup_table_data);
+    return lookup_table;
 }
 
 FourierTransform::~FourierTransform() {
     blast::GfxDevice* device = context->device;
-    device->DestroyTexture(pass_texture0);
-    device->DestroyTexture(pass_texture1);
+    for (int i = 0; i < max_count; i++) {
+        device->DestroyTexture(pass_textures0[i]);
+        device->DestroyTexture(pass_textures1[i]);
+    }
     device->DestroyBuffer(butterfly_lookup_table);
+    if (half_butterfly_lookup_table) {
+        device->DestroyBuffer(half_butterfly_lookup_table);
+    }
 }
 
 void FourierTransform::Execute(blast::GfxCommandBuffer* cmd, blast::GfxTexture* in, blast::GfxTexture* out) {
+    Execute(cmd, &in, &out, 1);
+}
+
+void FourierTransform::Execute(blast::GfxCommandBuffer* cmd, blast::GfxTexture* const* in, blast::GfxTexture* const* out, int count) {
     blast::GfxDevice* device = context->device;
+    assert(count <= max_count);
+
+    std::vector<blast::GfxTextureBarrier> texture_barriers(count * 4);
+    for (int i = 0; i < count; i++) {
+        texture_barriers[i * 4 + 0].texture = in[i];
+        texture_barriers[i * 4 + 1].texture = out[i];
+        texture_barriers[i * 4 + 2].texture = pass_textures0[i];
+        texture_barriers[i * 4 + 3].texture = pass_textures1[i];
+    }
+    for (blast::GfxTextureBarrier& barrier : texture_barriers) {
+        barrier.new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
+    }
+    device->SetBarrier(cmd, 0, nullptr, count * 4, texture_barriers.data());
 
-    blast::GfxTextureBarrier texture_barriers[4];
-    texture_barriers[0].texture = in;
-    texture_barriers[0].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
-    texture_barriers[1].texture = out;
-    texture_barriers[1].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
-    texture_barriers[2].texture = pass_texture0;
-    texture_barriers[2].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
-    texture_barriers[3].texture = pass_texture1;
-    texture_barriers[3].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
-    device->SetBarrier(cmd, 0, nullptr, 4, texture_barriers);
+    uint32_t group_count_x = std::max(1u, (uint32_t)(real_output ? size / 2 : size) / 16);
+    uint32_t group_count_y = std::max(1u, (uint32_t)(size) / 16);
 
     // Copy To In
     device->BindComputeShader(cmd, context->copy_shader);
 
-    device->BindUAV(cmd, in, 0);
+    for (int i = 0; i < count; i++) {
+        device->BindUAV(cmd, in[i], 0);
 
-    device->BindUAV(cmd, pass_texture0, 1);
+        device->BindUAV(cmd, pass_textures0[i], 1);
 
-    device->Dispatch(cmd, std::max(1u, (uint32_t)(size) / 16), std::max(1u, (uint32_t)(size) / 16), 1);
+        device->Dispatch(cmd, group_count_x, group_count_y, 1);
+    }
 
     FFTParam fft_param;
     fft_param.size = size;
@@ -130,59 +155,95 @@ void FourierTransform::Execute(blast::GfxCommandBuffer* cmd, blast::GfxTexture*
     fft_param.ping_pong = false;
     fft_param.is_horizontal = true;
 
-    //Horizontal Step
-    for (int i = 0; i < passes; ++i) {
-        fft_param.pass = i;
+    if (real_output) {
+        // Columns first so every row is hermitian, then each row runs as a half length complex transform
+        fft_param.is_horizontal = false;
+        DispatchPasses(cmd, fft_param, passes, butterfly_lookup_table, count, group_count_x, group_count_y);
+
+        C2RParam c2r_param;
+        c2r_param.size = size;
+        c2r_param.stage = 0;
+        DispatchC2R(cmd, c2r_param, fft_param.ping_pong, nullptr, count, group_count_x, group_count_y);
         fft_param.ping_pong = !fft_param.ping_pong;
 
-        device->BindComputeShader(cmd, context->fft_shader);
+        fft_param.size = size / 2;
+        fft_param.is_horizontal = true;
+        DispatchPasses(cmd, fft_param, passes - 1, half_butterfly_lookup_table, count, group_count_x, group_count_y);
 
-        device->BindUAV(cmd, pass_texture0, 0);
+        c2r_param.stage = 1;
+        DispatchC2R(cmd, c2r_param, fft_param.ping_pong, out, count, group_count_x, group_count_y);
+    } else {
+        //Horizontal Step
+        DispatchPasses(cmd, fft_param, passes, butterfly_lookup_table, count, group_count_x, group_count_y);
 
-        device->BindUAV(cmd, pass_texture1, 1);
+        //Vertical Step
+        fft_param.is_horizontal = false;
+        DispatchPasses(cmd, fft_param, passes, butterfly_lookup_table, count, group_count_x, group_count_y);
 
-        device->BindUAV(cmd, butterfly_lookup_table, 2);
+        // Copy To Out
+        device->BindComputeShader(cmd, context->copy_shader);
 
-        device->PushConstants(cmd, &fft_param, sizeof(FFTParam));
+        for (int i = 0; i < count; i++) {
+            if (fft_param.ping_pong) {
+                device->BindUAV(cmd, pass_textures1[i], 0);
+            } else {
+                device->BindUAV(cmd, pass_textures0[i], 0);
+            }
+
+            device->BindUAV(cmd, out[i], 1);
 
-        device->Dispatch(cmd, std::max(1u, (uint32_t)(size) / 16), std::max(1u, (uint32_t)(size) / 16), 1);
+            device->Dispatch(cmd, group_count_x, group_count_y, 1);
+        }
     }
 
-    //Vertical Step
-    fft_param.is_horizontal = false;
-    for (int i = 0; i < passes; ++i) {
+    for (int i = 0; i < count; i++) {
+        texture_barriers[i * 2 + 0].texture = in[i];
+        texture_barriers[i * 2 + 0].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
+        texture_barriers[i * 2 + 1].texture = out[i];
+        texture_barriers[i * 2 + 1].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
+    }
+    device->SetBarrier(cmd, 0, nullptr, count * 2, texture_barriers.data());
+}
+
+void FourierTransform::DispatchPasses(blast::GfxCommandBuffer* cmd, FFTParam& fft_param, int pass_count, blast::GfxBuffer* lookup_table, int count,
+                                      uint32_t group_count_x, uint32_t group_count_y) {
+    blast::GfxDevice* device = context->device;
+    for (int i = 0; i < pass_count; ++i) {
         fft_param.pass = i;
         fft_param.ping_pong = !fft_param.ping_pong;
 
         device->BindComputeShader(cmd, context->fft_shader);
 
-        device->BindUAV(cmd, pass_texture0, 0);
+        device->BindUAV(cmd, lookup_table, 2);
 
-        device->BindUAV(cmd, pass_texture1, 1);
+        device->PushConstants(cmd, &fft_param, sizeof(FFTParam));
 
-        device->BindUAV(cmd, butterfly_lookup_table, 2);
+        // Every texture of the batch reads the same twiddles of this pass
+        for (int j = 0; j < count; j++) {
+            device->BindUAV(cmd, pass_textures0[j], 0);
 
-        device->PushConstants(cmd, &fft_param, sizeof(FFTParam));
+            device->BindUAV(cmd, pass_textures1[j], 1);
 
-        device->Dispatch(cmd, std::max(1u, (uint32_t)(size) / 16), std::max(1u, (uint32_t)(size) / 16), 1);
+            device->Dispatch(cmd, group_count_x, group_count_y, 1);
+        }
     }
+}
 
-    // Copy To Out
-    device->BindComputeShader(cmd, context->copy_shader);
+void FourierTransform::DispatchC2R(blast::GfxCommandBuffer* cmd, const C2RParam& c2r_param, bool ping_pong, blast::GfxTexture* const* out, int count,
+                                   uint32_t group_count_x, uint32_t group_count_y) {
+    blast::GfxDevice* device = context->device;
+    device->BindComputeShader(cmd, context->c2r_shader);
 
-    if (fft_param.ping_pong) {
-        device->BindUAV(cmd, pass_texture1, 0);
-    } else {
-        device->BindUAV(cmd, pass_texture0, 0);
-    }
+    device->PushConstants(cmd, &c2r_param, sizeof(C2RParam));
 
-    device->BindUAV(cmd, out, 1);
+    // Reads the pass texture holding the latest result and writes the other one, or out when given
+    for (int i = 0; i < count; i++) {
+        blast::GfxTexture* source = ping_pong ? pass_textures1[i] : pass_textures0[i];
+        blast::GfxTexture* dest = ping_pong ? pass_textures0[i] : pass_textures1[i];
+        device->BindUAV(cmd, source, 0);
 
-    device->Dispatch(cmd, std::max(1u, (uint32_t)(size) / 16), std::max(1u, (uint32_t)(size) / 16), 1);
+        device->BindUAV(cmd, out ? out[i] : dest, 1);
 
-    texture_barriers[0].texture = in;
-    texture_barriers[0].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
-    texture_barriers[1].texture = out;
-    texture_barriers[1].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
-    device->SetBarrier(cmd, 0, nullptr, 2, texture_barriers);
-}
\ No newline at end of file
+        device->Dispatch(cmd, group_count_x, group_count_y, 1);
+    }
+}
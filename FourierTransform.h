@@ -8,25 +8,58 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 
+#include <vector>
+
 class FourierTransform {
 public:
-    FourierTransform(Context* context, int size);
+    // With real_output the input is a (size / 2) x size hermitian half spectrum whose nyquist column is packed into
+    // the imaginary part of column 0, and the size x size real result is written to the red channel of out.
+    // Up to max_count textures are transformed per Execute.
+    FourierTransform(Context* context, int size, bool real_output = false, int max_count = 1);
 
     ~FourierTransform();
 
     void Execute(blast::GfxCommandBuffer* cmd, blast::GfxTexture* in, blast::GfxTexture* out);
 
+    // Transforms in[i] into out[i] for i < count. Each pass binds its shader, lookup table and constants once and dispatches
+    // every texture with no barrier in between, so the dispatches of one pass can overlap on the gpu. count is at most max_count.
+    void Execute(blast::GfxCommandBuffer* cmd, blast::GfxTexture* const* in, blast::GfxTexture* const* out, int count);
+
 private:
     struct LookUp {
         int j1, j2;
         float wr, wi;
     };
 
+    struct FFTParam {
+        int size;
+        int pass;
+        int ping_pong;
+        int is_horizontal;
+    };
+
+    struct C2RParam {
+        int size;
+        int stage;
+    };
+
+    blast::GfxBuffer* CreateButterflyLookupTable(int n, int n_passes);
+
+    void DispatchPasses(blast::GfxCommandBuffer* cmd, FFTParam& fft_param, int pass_count, blast::GfxBuffer* lookup_table, int count,
+                        uint32_t group_count_x, uint32_t group_count_y);
+
+    void DispatchC2R(blast::GfxCommandBuffer* cmd, const C2RParam& c2r_param, bool ping_pong, blast::GfxTexture* const* out, int count,
+                     uint32_t group_count_x, uint32_t group_count_y);
+
 private:
     int size = 0;
     int passes = 0;
+    bool real_output = false;
+    int max_count = 1;
     Context* context = nullptr;
-    blast::GfxTexture* pass_texture0 = nullptr;
-    blast::GfxTexture* pass_texture1 = nullptr;
+    // One ping-pong pair per texture of a batch
+    std::vector<blast::GfxTexture*> pass_textures0;
+    std::vector<blast::GfxTexture*> pass_textures1;
     blast::GfxBuffer* butterfly_lookup_table = nullptr;
+    blast::GfxBuffer* half_butterfly_lookup_table = nullptr;
 };
\ No newline at end of file
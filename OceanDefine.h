@@ -69,10 +69,62 @@ struct Context {
     blast::GfxDevice* device;
     blast::GfxShader* copy_shader;
     blast::GfxShader* fft_shader;
+    blast::GfxShader* c2r_shader;
+    blast::GfxShader* loop_shader;
 };
 
-#define RAND_MAX 0x7fff
+// Philox4x32-10 counter based generator (Salmon et al. 2011), the output is a pure function of counter and key
+inline void Philox4x32(uint32_t counter[4], uint32_t key[2]) {
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t product0 = (uint64_t)0xD2511F53u * counter[0];
+        uint64_t product1 = (uint64_t)0xCD9E8D57u * counter[2];
+        uint32_t c0 = (uint32_t)(product1 >> 32u) ^ counter[1] ^ k0;
+        uint32_t c1 = (uint32_t)product1;
+        uint32_t c2 = (uint32_t)(product0 >> 32u) ^ counter[3] ^ k1;
+        uint32_t c3 = (uint32_t)product0;
+        counter[0] = c0;
+        counter[1] = c1;
+        counter[2] = c2;
+        counter[3] = c3;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+// Box-Muller on top of Philox, with log and sincos written out in plain double arithmetic instead of libm
+// so every IEEE-754 machine produces the same bits. Callers build with -ffp-contract=off so the compiler does not fuse it into fma.
+inline glm::vec2 GaussianPair(uint32_t seed, int n, int m, int stream) {
+    uint32_t counter[4] = { (uint32_t)n, (uint32_t)m, (uint32_t)stream, 0u };
+    uint32_t key[2] = { seed, 0x6f636561u };
+    Philox4x32(counter, key);
+
+    // u1 in (0, 1], u2 in [0, 1)
+    double u1 = ((counter[0] >> 8u) + 1.0) * (1.0 / 16777216.0);
+    double u2 = (counter[1] >> 8u) * (1.0 / 16777216.0);
+
+    // log(u1) = e * ln2 + log(f), f in [sqrt(0.5), sqrt(2)), log(f) = 2 * atanh((f - 1) / (f + 1))
+    int e = 0;
+    double f = u1;
+    while (f < 0.7071067811865476) {
+        f *= 2.0;
+        e--;
+    }
+    double s = (f - 1.0) / (f + 1.0);
+    double s2 = s * s;
+    double log_f = 2.0 * s * (1.0 + s2 * (1.0 / 3.0 + s2 * (1.0 / 5.0 + s2 * (1.0 / 7.0 + s2 * (1.0 / 9.0 + s2 * (1.0 / 11.0 + s2 / 13.0))))));
+    double radius = sqrt(-2.0 * (e * 0.6931471805599453 + log_f));
+
+    // sincos(2 * PI * u2) from the quadrant and a Taylor series on [0, PI / 2)
+    double x = u2 * 4.0;
+    int quadrant = (int)x;
+    double a = (x - quadrant) * 1.5707963267948966;
+    double a2 = a * a;
+    double sin_a = a * (1.0 - a2 / 6.0 * (1.0 - a2 / 20.0 * (1.0 - a2 / 42.0 * (1.0 - a2 / 72.0 * (1.0 - a2 / 110.0 * (1.0 - a2 / 156.0 * (1.0 - a2 / 210.0)))))));
+    double cos_a = 1.0 - a2 / 2.0 * (1.0 - a2 / 12.0 * (1.0 - a2 / 30.0 * (1.0 - a2 / 56.0 * (1.0 - a2 / 90.0 * (1.0 - a2 / 132.0 * (1.0 - a2 / 182.0 * (1.0 - a2 / 240.0)))))));
+    double sin_t = quadrant == 0 ? sin_a : quadrant == 1 ? cos_a : quadrant == 2 ? -sin_a : -cos_a;
+    double cos_t = quadrant == 0 ? cos_a : quadrant == 1 ? -sin_a : quadrant == 2 ? -cos_a : sin_a;
 
-inline float UniformRandomVariable() {
-    return (float)rand()/RAND_MAX;
+    return glm::vec2((float)(radius * cos_t), (float)(radius * sin_t));
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "SpectrumCache.h"
+#include "OceanDefine.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SPECTRUM_CACHE_MAGIC 0x4350534fu
+#define SPECTRUM_CACHE_VERSION 1u
+
+// 64 bytes, so the tables after it keep the alignment of the mapping
+struct SpectrumCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t hash;
+    uint32_t header_size;
+    uint64_t float_count;
+    SpectrumCacheKey key;
+    uint8_t reserved[8];
+};
+
+static_assert(sizeof(SpectrumCacheHeader) == 64, "SpectrumCacheHeader must stay 64 bytes");
+
+static void FillHeader(const SpectrumCacheKey& key, size_t float_count, SpectrumCacheHeader* header) {
+    *header = SpectrumCacheHeader();
+    header->magic = SPECTRUM_CACHE_MAGIC;
+    header->version = SPECTRUM_CACHE_VERSION;
+    header->hash = MurmurHash<SpectrumCacheKey>()(key);
+    header->header_size = sizeof(SpectrumCacheHeader);
+    header->float_count = float_count;
+    header->key = key;
+}
+
+SpectrumCache::~SpectrumCache() {
+    Unmap();
+}
+
+std::string SpectrumCache::GetPath(const std::string& directory, const SpectrumCacheKey& key) {
+    char name[32];
+    snprintf(name, sizeof(name), "spectrum_%08x.bin", MurmurHash<SpectrumCacheKey>()(key));
+    return directory + "/" + name;
+}
+
+float* SpectrumCache::Map(const std::string& directory, const SpectrumCacheKey& key, size_t float_count) {
+    Unmap();
+
+    std::string path = GetPath(directory, key);
+    size_t file_size = sizeof(SpectrumCacheHeader) + float_count * sizeof(float);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER actual_size;
+    if (!GetFileSizeEx(file, &actual_size) || (uint64_t)actual_size.QuadPart != file_size) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping_object = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    void* view = mapping_object ? MapViewOfFile(mapping_object, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping_object) {
+            CloseHandle(mapping_object);
+        }
+        CloseHandle(file);
+        return nullptr;
+    }
+    file_handle = file;
+    mapping_handle = mapping_object;
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || (uint64_t)file_stat.st_size != file_size) {
+        close(file);
+        return nullptr;
+    }
+    void* view = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+#endif
+    mapping = view;
+    mapping_size = file_size;
+
+    SpectrumCacheHeader expected;
+    FillHeader(key, float_count, &expected);
+    if (memcmp(mapping, &expected, sizeof(SpectrumCacheHeader)) != 0) {
+        Unmap();
+        return nullptr;
+    }
+    return (float*)((uint8_t*)mapping + sizeof(SpectrumCacheHeader));
+}
+
+void SpectrumCache::Unmap() {
+    if (!mapping) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    munmap(mapping, mapping_size);
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+}
+
+bool SpectrumCache::Store(const std::string& directory, const SpectrumCacheKey& key, const float* data, size_t float_count) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+    int pid = _getpid();
+#else
+    mkdir(directory.c_str(), 0755);
+    int pid = (int)getpid();
+#endif
+    std::string path = GetPath(directory, key);
+    std::string temp_path = path + "." + std::to_string(pid) + ".tmp";
+
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    SpectrumCacheHeader header;
+    FillHeader(key, float_count, &header);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, sizeof(float), float_count, file) == float_count;
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        remove(temp_path.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        remove(temp_path.c_str());
+    }
+    return renamed;
+}
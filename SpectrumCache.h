@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Everything the initial spectrum and dispersion tables depend on. Hashed with murmur3 for the file name
+// and stored verbatim in the header, so a hash collision never maps the wrong ocean.
+struct SpectrumCacheKey {
+    int32_t size = 0;
+    int32_t length = 0;
+    float wind_speed_x = 0.0f;
+    float wind_speed_y = 0.0f;
+    float wave_amp = 0.0f;
+    uint32_t seed = 0;
+    int32_t model = 0;
+    int32_t layout = 0;
+};
+
+// Versioned binary file of spectrum tables in a cache directory, memory mapped copy-on-write so identical
+// processes on one machine share the pages and a fresh start skips the spectrum derivation.
+class SpectrumCache {
+public:
+    SpectrumCache() = default;
+
+    ~SpectrumCache();
+
+    // Maps the tables for key, nullptr when the file is missing, from another version or of a different size.
+    // The mapping stays valid until Unmap or destruction, writes to it are private to this process.
+    float* Map(const std::string& directory, const SpectrumCacheKey& key, size_t float_count);
+
+    void Unmap();
+
+    // Writes the tables through a temporary file and a rename, so concurrent readers never see a partial file.
+    static bool Store(const std::string& directory, const SpectrumCacheKey& key, const float* data, size_t float_count);
+
+private:
+    static std::string GetPath(const std::string& directory, const SpectrumCacheKey& key);
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
@@ -0,0 +1,919 @@
+#include "SpectrumKernel.h"
+
+#include <gtc/constants.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OCEAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define OCEAN_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define OCEAN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#else
+#define OCEAN_X86 0
+#endif
+
+#if OCEAN_X86
+static void CpuId(int leaf, int sub_leaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, leaf, sub_leaf);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned int)info[i];
+#else
+    __cpuid_count(leaf, sub_leaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t XGetBv() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
+
+static SimdLevel DetectSimdLevel() {
+#if OCEAN_X86
+    unsigned int regs[4];
+    CpuId(0, 0, regs);
+    unsigned int max_leaf = regs[0];
+
+    CpuId(1, 0, regs);
+    bool sse2 = (regs[3] >> 26) & 1;
+    bool fma = (regs[2] >> 12) & 1;
+    bool osxsave = (regs[2] >> 27) & 1;
+    bool avx = (regs[2] >> 28) & 1;
+    if (!sse2) {
+        return SIMD_LEVEL_SCALAR;
+    }
+
+    // The OS must save the ymm state too, otherwise avx instructions fault
+    if (max_leaf >= 7 && fma && osxsave && avx && (XGetBv() & 0x6) == 0x6) {
+        CpuId(7, 0, regs);
+        if ((regs[1] >> 5) & 1) {
+            return SIMD_LEVEL_AVX2;
+        }
+    }
+    return SIMD_LEVEL_SSE2;
+#else
+    return SIMD_LEVEL_SCALAR;
+#endif
+}
+
+SimdLevel GetSimdLevel() {
+    static SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+// Cephes sincos constants, shared by the SSE2 and AVX2 kernels
+#define SINCOS_FOPI 1.27323954473516f
+#define SINCOS_DP1 -0.78515625f
+#define SINCOS_DP2 -2.4187564849853515625e-4f
+#define SINCOS_DP3 -3.77489497744594108e-8f
+#define SINCOS_SIN_P0 -1.9515295891e-4f
+#define SINCOS_SIN_P1 8.3321608736e-3f
+#define SINCOS_SIN_P2 -1.6666654611e-1f
+#define SINCOS_COS_P0 2.443315711809948e-5f
+#define SINCOS_COS_P1 -1.388731625493765e-3f
+#define SINCOS_COS_P2 4.166664568298827e-2f
+
+static inline glm::vec2 EvolveBin(float cos, float sin, float h0_re, float h0_im, float h0_conj_re, float h0_conj_im) {
+    float c0a = h0_re * cos - h0_im * sin;
+    float c0b = h0_re * sin + h0_im * cos;
+
+    float c1a = h0_conj_re * cos - h0_conj_im * -sin;
+    float c1b = h0_conj_re * -sin + h0_conj_im * cos;
+
+    return glm::vec2(c0a + c1a, c0b + c1b);
+}
+
+#if OCEAN_X86
+static inline void SinCosSSE2(__m128 x, __m128* s, __m128* c) {
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    __m128 sign_bit_sin = _mm_and_ps(x, sign_mask);
+    x = _mm_andnot_ps(sign_mask, x);
+
+    // Octant of |x|, rounded up to an even number
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(SINCOS_FOPI)));
+    j = _mm_add_epi32(j, _mm_set1_epi32(1));
+    j = _mm_and_si128(j, _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(j);
+
+    __m128 swap_sign_bit_sin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+    __m128 poly_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+    __m128i k = _mm_sub_epi32(j, _mm_set1_epi32(2));
+    __m128 sign_bit_cos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(k, _mm_set1_epi32(4)), 29));
+    sign_bit_sin = _mm_xor_ps(sign_bit_sin, swap_sign_bit_sin);
+
+    // Extended precision modular arithmetic
+    x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(SINCOS_DP1)));
+    x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(SINCOS_DP2)));
+    x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(SINCOS_DP3)));
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 yc = _mm_set1_ps(SINCOS_COS_P0);
+    yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(SINCOS_COS_P1));
+    yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(SINCOS_COS_P2));
+    yc = _mm_mul_ps(_mm_mul_ps(yc, z), z);
+    yc = _mm_sub_ps(yc, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    yc = _mm_add_ps(yc, _mm_set1_ps(1.0f));
+
+    __m128 ys = _mm_set1_ps(SINCOS_SIN_P0);
+    ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(SINCOS_SIN_P1));
+    ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(SINCOS_SIN_P2));
+    ys = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ys, z), x), x);
+
+    __m128 sin = _mm_or_ps(_mm_and_ps(poly_mask, ys), _mm_andnot_ps(poly_mask, yc));
+    __m128 cos = _mm_or_ps(_mm_and_ps(poly_mask, yc), _mm_andnot_ps(poly_mask, ys));
+    *s = _mm_xor_ps(sin, sign_bit_sin);
+    *c = _mm_xor_ps(cos, sign_bit_cos);
+}
+
+// h0 * e^(i * omega * t) + conj(h0(-k)) * e^(-i * omega * t) for 4 bins, stored as interleaved complex
+static inline void EvolveBlockSSE2(__m128 cos, __m128 sin, __m128 h0_re, __m128 h0_im, __m128 h0_conj_re, __m128 h0_conj_im, glm::vec2* out) {
+    __m128 re = _mm_add_ps(_mm_mul_ps(_mm_add_ps(h0_re, h0_conj_re), cos), _mm_mul_ps(_mm_sub_ps(h0_conj_im, h0_im), sin));
+    __m128 im = _mm_add_ps(_mm_mul_ps(_mm_add_ps(h0_im, h0_conj_im), cos), _mm_mul_ps(_mm_sub_ps(h0_re, h0_conj_re), sin));
+
+    _mm_storeu_ps(&out[0].x, _mm_unpacklo_ps(re, im));
+    _mm_storeu_ps(&out[2].x, _mm_unpackhi_ps(re, im));
+}
+
+OCEAN_TARGET_AVX2 static inline void SinCosAVX2(__m256 x, __m256* s, __m256* c) {
+    const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    __m256 sign_bit_sin = _mm256_and_ps(x, sign_mask);
+    x = _mm256_andnot_ps(sign_mask, x);
+
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(SINCOS_FOPI)));
+    j = _mm256_add_epi32(j, _mm256_set1_epi32(1));
+    j = _mm256_and_si256(j, _mm256_set1_epi32(~1));
+    __m256 y = _mm256_cvtepi32_ps(j);
+
+    __m256 swap_sign_bit_sin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+    __m256 poly_mask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+    __m256i k = _mm256_sub_epi32(j, _mm256_set1_epi32(2));
+    __m256 sign_bit_cos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(k, _mm256_set1_epi32(4)), 29));
+    sign_bit_sin = _mm256_xor_ps(sign_bit_sin, swap_sign_bit_sin);
+
+    x = _mm256_fmadd_ps(y, _mm256_set1_ps(SINCOS_DP1), x);
+    x = _mm256_fmadd_ps(y, _mm256_set1_ps(SINCOS_DP2), x);
+    x = _mm256_fmadd_ps(y, _mm256_set1_ps(SINCOS_DP3), x);
+    __m256 z = _mm256_mul_ps(x, x);
+
+    __m256 yc = _mm256_set1_ps(SINCOS_COS_P0);
+    yc = _mm256_fmadd_ps(yc, z, _mm256_set1_ps(SINCOS_COS_P1));
+    yc = _mm256_fmadd_ps(yc, z, _mm256_set1_ps(SINCOS_COS_P2));
+    yc = _mm256_mul_ps(_mm256_mul_ps(yc, z), z);
+    yc = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), yc);
+    yc = _mm256_add_ps(yc, _mm256_set1_ps(1.0f));
+
+    __m256 ys = _mm256_set1_ps(SINCOS_SIN_P0);
+    ys = _mm256_fmadd_ps(ys, z, _mm256_set1_ps(SINCOS_SIN_P1));
+    ys = _mm256_fmadd_ps(ys, z, _mm256_set1_ps(SINCOS_SIN_P2));
+    ys = _mm256_fmadd_ps(_mm256_mul_ps(ys, z), x, x);
+
+    __m256 sin = _mm256_blendv_ps(yc, ys, poly_mask);
+    __m256 cos = _mm256_blendv_ps(ys, yc, poly_mask);
+    *s = _mm256_xor_ps(sin, sign_bit_sin);
+    *c = _mm256_xor_ps(cos, sign_bit_cos);
+}
+
+OCEAN_TARGET_AVX2 static inline void EvolveBlockAVX2(__m256 cos, __m256 sin, __m256 h0_re, __m256 h0_im, __m256 h0_conj_re, __m256 h0_conj_im, glm::vec2* out) {
+    __m256 re = _mm256_fmadd_ps(_mm256_add_ps(h0_re, h0_conj_re), cos, _mm256_mul_ps(_mm256_sub_ps(h0_conj_im, h0_im), sin));
+    __m256 im = _mm256_fmadd_ps(_mm256_add_ps(h0_im, h0_conj_im), cos, _mm256_mul_ps(_mm256_sub_ps(h0_re, h0_conj_re), sin));
+
+    // unpack works per 128 bit lane, so swap the middle halves back into order
+    __m256 lo = _mm256_unpacklo_ps(re, im);
+    __m256 hi = _mm256_unpackhi_ps(re, im);
+    _mm256_storeu_ps(&out[0].x, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(&out[4].x, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+#endif
+
+// Phase sources for the kernels below, either computing cos/sin(omega * t) or looking them up by whole omega
+struct DirectPhase {
+    float t;
+
+    void Scalar(float omega, float* cos, float* sin) const {
+        float omegat = omega * t;
+        *cos = glm::cos(omegat);
+        *sin = glm::sin(omegat);
+    }
+
+#if OCEAN_X86
+    void SSE2(const float* omega, __m128* cos, __m128* sin) const {
+        SinCosSSE2(_mm_mul_ps(_mm_loadu_ps(omega), _mm_set1_ps(t)), sin, cos);
+    }
+
+    OCEAN_TARGET_AVX2 void AVX2(const float* omega, __m256* cos, __m256* sin) const {
+        SinCosAVX2(_mm256_mul_ps(_mm256_loadu_ps(omega), _mm256_set1_ps(t)), sin, cos);
+    }
+#endif
+};
+
+struct TablePhase {
+    const float* cos_table;
+    const float* sin_table;
+
+    void Scalar(float omega, float* cos, float* sin) const {
+        int index = (int)omega;
+        *cos = cos_table[index];
+        *sin = sin_table[index];
+    }
+
+#if OCEAN_X86
+    void SSE2(const float* omega, __m128* cos, __m128* sin) const {
+        alignas(16) int index[4];
+        _mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_loadu_ps(omega)));
+        *cos = _mm_setr_ps(cos_table[index[0]], cos_table[index[1]], cos_table[index[2]], cos_table[index[3]]);
+        *sin = _mm_setr_ps(sin_table[index[0]], sin_table[index[1]], sin_table[index[2]], sin_table[index[3]]);
+    }
+
+    OCEAN_TARGET_AVX2 void AVX2(const float* omega, __m256* cos, __m256* sin) const {
+        __m256i index = _mm256_cvttps_epi32(_mm256_loadu_ps(omega));
+        *cos = _mm256_i32gather_ps(cos_table, index, 4);
+        *sin = _mm256_i32gather_ps(sin_table, index, 4);
+    }
+#endif
+};
+
+template<typename Phase>
+static void EvolveRangeScalar(const SpectrumData& data, const Phase& phase, int begin, int end, glm::vec2* out) {
+    for (int i = begin; i < end; i++) {
+        float cos, sin;
+        phase.Scalar(data.omega[i], &cos, &sin);
+        out[i] = EvolveBin(cos, sin, data.h0_re[i], data.h0_im[i], data.h0_conj_re[i], data.h0_conj_im[i]);
+    }
+}
+
+#if OCEAN_X86
+template<typename Phase>
+static int EvolveRangeSSE2(const SpectrumData& data, const Phase& phase, int begin, int end, glm::vec2* out) {
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 cos, sin;
+        phase.SSE2(data.omega + i, &cos, &sin);
+        EvolveBlockSSE2(cos, sin, _mm_loadu_ps(data.h0_re + i), _mm_loadu_ps(data.h0_im + i),
+                        _mm_loadu_ps(data.h0_conj_re + i), _mm_loadu_ps(data.h0_conj_im + i), out + i);
+    }
+    return i;
+}
+
+template<typename Phase>
+OCEAN_TARGET_AVX2 static int EvolveRangeAVX2(const SpectrumData& data, const Phase& phase, int begin, int end, glm::vec2* out) {
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 cos, sin;
+        phase.AVX2(data.omega + i, &cos, &sin);
+        EvolveBlockAVX2(cos, sin, _mm256_loadu_ps(data.h0_re + i), _mm256_loadu_ps(data.h0_im + i),
+                        _mm256_loadu_ps(data.h0_conj_re + i), _mm256_loadu_ps(data.h0_conj_im + i), out + i);
+    }
+    return i;
+}
+#endif
+
+template<typename Phase>
+static void EvolveRange(const SpectrumData& data, const Phase& phase, int begin, int end, glm::vec2* out, SimdLevel level) {
+    int i = begin;
+#if OCEAN_X86
+    if (level >= SIMD_LEVEL_AVX2) {
+        i = EvolveRangeAVX2(data, phase, i, end, out);
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        i = EvolveRangeSSE2(data, phase, i, end, out);
+    }
+#endif
+    EvolveRangeScalar(data, phase, i, end, out);
+}
+
+// One half spectrum row, conj(h0(-k)) is read from the reversed mirror row so bin m pairs with mirror[(size - m) % size].
+struct HalfRow {
+    const float* omega;
+    const float* h0_re;
+    const float* h0_im;
+    const float* mirror_re;
+    const float* mirror_im;
+    int size;
+};
+
+template<typename Phase>
+static inline glm::vec2 EvolveHalfBin(const HalfRow& row, const Phase& phase, int m) {
+    int mirror_m = (row.size - m) % row.size;
+    float cos, sin;
+    phase.Scalar(row.omega[m], &cos, &sin);
+    return EvolveBin(cos, sin, row.h0_re[m], row.h0_im[m], row.mirror_re[mirror_m], -row.mirror_im[mirror_m]);
+}
+
+template<typename Phase>
+static void EvolveHalfRowScalar(const HalfRow& row, const Phase& phase, int begin, int end, glm::vec2* out) {
+    for (int m = begin; m < end; m++) {
+        out[m] = EvolveHalfBin(row, phase, m);
+    }
+}
+
+#if OCEAN_X86
+template<typename Phase>
+static int EvolveHalfRowSSE2(const HalfRow& row, const Phase& phase, int begin, int end, glm::vec2* out) {
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    int m = begin;
+    for (; m + 4 <= end; m += 4) {
+        __m128 conj_re = _mm_loadu_ps(row.mirror_re + row.size - m - 3);
+        __m128 conj_im = _mm_loadu_ps(row.mirror_im + row.size - m - 3);
+        conj_re = _mm_shuffle_ps(conj_re, conj_re, _MM_SHUFFLE(0, 1, 2, 3));
+        conj_im = _mm_xor_ps(_mm_shuffle_ps(conj_im, conj_im, _MM_SHUFFLE(0, 1, 2, 3)), sign_mask);
+
+        __m128 cos, sin;
+        phase.SSE2(row.omega + m, &cos, &sin);
+        EvolveBlockSSE2(cos, sin, _mm_loadu_ps(row.h0_re + m), _mm_loadu_ps(row.h0_im + m), conj_re, conj_im, out + m);
+    }
+    return m;
+}
+
+template<typename Phase>
+OCEAN_TARGET_AVX2 static int EvolveHalfRowAVX2(const HalfRow& row, const Phase& phase, int begin, int end, glm::vec2* out) {
+    const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    int m = begin;
+    for (; m + 8 <= end; m += 8) {
+        __m256 conj_re = _mm256_permutevar8x32_ps(_mm256_loadu_ps(row.mirror_re + row.size - m - 7), reverse);
+        __m256 conj_im = _mm256_permutevar8x32_ps(_mm256_loadu_ps(row.mirror_im + row.size - m - 7), reverse);
+        conj_im = _mm256_xor_ps(conj_im, sign_mask);
+
+        __m256 cos, sin;
+        phase.AVX2(row.omega + m, &cos, &sin);
+        EvolveBlockAVX2(cos, sin, _mm256_loadu_ps(row.h0_re + m), _mm256_loadu_ps(row.h0_im + m), conj_re, conj_im, out + m);
+    }
+    return m;
+}
+#endif
+
+template<typename Phase>
+static void EvolveHalfRows(const SpectrumData& data, const Phase& phase, int size, int row_begin, int row_end, glm::vec2* out, bool pack_nyquist,
+                           SimdLevel level) {
+    int half = size / 2;
+    int out_stride = pack_nyquist ? half : half + 1;
+    for (int n = row_begin; n < row_end; n++) {
+        int mirror_n = (size - n) % size;
+        HalfRow row;
+        row.omega = data.omega + n * (half + 1);
+        row.h0_re = data.h0_re + n * size;
+        row.h0_im = data.h0_im + n * size;
+        row.mirror_re = data.h0_re + mirror_n * size;
+        row.mirror_im = data.h0_im + mirror_n * size;
+        row.size = size;
+        glm::vec2* out_row = out + n * out_stride;
+
+        // Column 0 and the nyquist column are their own mirrors
+        glm::vec2 dc = EvolveHalfBin(row, phase, 0);
+        glm::vec2 nyquist = EvolveHalfBin(row, phase, half);
+
+        int m = 1;
+#if OCEAN_X86
+        if (level >= SIMD_LEVEL_AVX2) {
+            m = EvolveHalfRowAVX2(row, phase, m, half, out_row);
+        }
+        if (level >= SIMD_LEVEL_SSE2) {
+            m = EvolveHalfRowSSE2(row, phase, m, half, out_row);
+        }
+#endif
+        EvolveHalfRowScalar(row, phase, m, half, out_row);
+
+        if (pack_nyquist) {
+            out_row[0] = dc + glm::vec2(-nyquist.y, nyquist.x);
+        } else {
+            out_row[0] = dc;
+            out_row[half] = nyquist;
+        }
+    }
+}
+
+// Evolves a chunk at a time into a stack buffer with the dense kernels, then scatters it
+#define SPARSE_CHUNK 64
+
+template<typename Phase>
+static void EvolveSparseRange(const SparseSpectrum& sparse, const Phase& phase, int begin, int end, glm::vec2* out, SimdLevel level) {
+    glm::vec2 chunk[SPARSE_CHUNK];
+    for (int i = begin; i < end; i += SPARSE_CHUNK) {
+        int count = std::min(SPARSE_CHUNK, end - i);
+        SpectrumData bins;
+        bins.h0_re = sparse.bins.h0_re + i;
+        bins.h0_im = sparse.bins.h0_im + i;
+        bins.h0_conj_re = sparse.bins.h0_conj_re + i;
+        bins.h0_conj_im = sparse.bins.h0_conj_im + i;
+        bins.omega = sparse.bins.omega + i;
+        EvolveRange(bins, phase, 0, count, chunk, level);
+
+        const int* index = sparse.index + i;
+        for (int j = 0; j < count; j++) {
+            out[index[j]] = chunk[j];
+        }
+    }
+}
+
+void EvolveSpectrum(const SpectrumData& data, float t, int begin, int end, glm::vec2* out, SimdLevel level) {
+    DirectPhase phase = { t };
+    EvolveRange(data, phase, begin, end, out, level);
+}
+
+void EvolveHalfSpectrum(const SpectrumData& data, float t, int size, int row_begin, int row_end, glm::vec2* out, bool pack_nyquist, SimdLevel level) {
+    DirectPhase phase = { t };
+    EvolveHalfRows(data, phase, size, row_begin, row_end, out, pack_nyquist, level);
+}
+
+void BuildPhaseTable(float t, PhaseTable& table) {
+    // Same float argument as the direct path, so the table entries match it bit for bit
+    for (int i = 0; i < table.count; i++) {
+        float omegat = (float)i * t;
+        table.cos_table[i] = glm::cos(omegat);
+        table.sin_table[i] = glm::sin(omegat);
+    }
+}
+
+void EvolveSpectrum(const SpectrumData& data, const PhaseTable& table, int begin, int end, glm::vec2* out, SimdLevel level) {
+    TablePhase phase = { table.cos_table, table.sin_table };
+    EvolveRange(data, phase, begin, end, out, level);
+}
+
+void EvolveHalfSpectrum(const SpectrumData& data, const PhaseTable& table, int size, int row_begin, int row_end, glm::vec2* out, bool pack_nyquist,
+                        SimdLevel level) {
+    TablePhase phase = { table.cos_table, table.sin_table };
+    EvolveHalfRows(data, phase, size, row_begin, row_end, out, pack_nyquist, level);
+}
+
+void EvolveSparseSpectrum(const SparseSpectrum& sparse, float t, int begin, int end, glm::vec2* out, SimdLevel level) {
+    DirectPhase phase = { t };
+    EvolveSparseRange(sparse, phase, begin, end, out, level);
+}
+
+void EvolveSparseSpectrum(const SparseSpectrum& sparse, const PhaseTable& table, int begin, int end, glm::vec2* out, SimdLevel level) {
+    TablePhase phase = { table.cos_table, table.sin_table };
+    EvolveSparseRange(sparse, phase, begin, end, out, level);
+}
+
+int SelectSpectrumBins(const float* energy, int size, int columns, bool mirror_pairs, double target_energy, int* kept, double* kept_energy) {
+    int bin_count = size * columns;
+    auto mirror = [&](int bin) {
+        return ((size - bin / columns) % size) * columns + (size - bin % columns) % size;
+    };
+
+    // One entry per pair under its lower bin, or per bin
+    std::vector<int> order;
+    std::vector<float> unit_energy(bin_count, 0.0f);
+    for (int bin = 0; bin < bin_count; bin++) {
+        int other = mirror_pairs ? mirror(bin) : bin;
+        if (bin <= other) {
+            order.push_back(bin);
+            unit_energy[bin] = other != bin ? energy[bin] + energy[other] : energy[bin];
+        }
+    }
+
+    // most energetic first, ties by bin so the kept set does not depend on the sort
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return unit_energy[a] > unit_energy[b] || (unit_energy[a] == unit_energy[b] && a < b);
+    });
+
+    int unit_count = (int)order.size();
+    int kept_count = 0;
+    for (int i = 0; i < unit_count && *kept_energy < target_energy && unit_energy[order[i]] > 0.0f; i++) {
+        int bin = order[i];
+        *kept_energy += unit_energy[bin];
+        kept[kept_count++] = bin;
+        if (mirror_pairs && mirror(bin) != bin) {
+            kept[kept_count++] = mirror(bin);
+        }
+    }
+
+    // back to bin order, so the scatter walks the output forward
+    std::sort(kept, kept + kept_count);
+    return kept_count;
+}
+
+template<typename Phase>
+static void EvolveChannelRow(const SpectrumData& data, const Phase& phase, int size, float length, int n, int channel_count, glm::vec2* out,
+                             size_t channel_stride, bool pack, SimdLevel level) {
+    size_t offset = (size_t)n * size;
+    SpectrumData row;
+    row.h0_re = data.h0_re + offset;
+    row.h0_im = data.h0_im + offset;
+    row.h0_conj_re = data.h0_conj_re + offset;
+    row.h0_conj_im = data.h0_conj_im + offset;
+    row.omega = data.omega + offset;
+    EvolveRange(row, phase, 0, size, out, level);
+    DeriveSpectrumChannels(size, length, n, channel_count, out, channel_stride, pack);
+}
+
+void EvolveSpectrumChannels(const SpectrumData& data, float t, int size, float length, int n, int channel_count, glm::vec2* out,
+                            size_t channel_stride, bool pack, SimdLevel level) {
+    DirectPhase phase = { t };
+    EvolveChannelRow(data, phase, size, length, n, channel_count, out, channel_stride, pack, level);
+}
+
+void EvolveSpectrumChannels(const SpectrumData& data, const PhaseTable& table, int size, float length, int n, int channel_count, glm::vec2* out,
+                            size_t channel_stride, bool pack, SimdLevel level) {
+    TablePhase phase = { table.cos_table, table.sin_table };
+    EvolveChannelRow(data, phase, size, length, n, channel_count, out, channel_stride, pack, level);
+}
+
+void DeriveSpectrumChannels(int size, float length, int n, int channel_count, glm::vec2* out, size_t channel_stride, bool pack) {
+    if (channel_count <= 1) {
+        return;
+    }
+    // Channel c lands in slot c, or in half c / 2 of slot c / 2 when packed
+    int shift = pack ? 1 : 0;
+    glm::vec2* slots[SPECTRUM_CHANNEL_COUNT];
+    for (int c = 0; c < channel_count; c++) {
+        slots[c] = out + (c >> shift) * channel_stride;
+    }
+
+    float scale = glm::pi<float>() / length;
+    float kx = scale * (2.0f * n - size);
+    float odd_kx = n == 0 ? 0.0f : kx;
+    for (int m = 0; m < size; m++) {
+        float kz = scale * (2.0f * m - size);
+        float odd_kz = m == 0 ? 0.0f : kz;
+        float k = glm::sqrt(kx * kx + kz * kz);
+        float inv_k = k > 0.0f ? 1.0f / k : 0.0f;
+
+        // i * h, both derivatives are real multiples of it
+        glm::vec2 ih = glm::vec2(-out[m].y, out[m].x);
+        glm::vec2 values[SPECTRUM_CHANNEL_COUNT] = {
+            out[m],
+            ih * (odd_kx * inv_k),
+            ih * (odd_kz * inv_k),
+            ih * -odd_kx,
+            ih * -odd_kz
+        };
+        if (pack) {
+            for (int c = 0; c < channel_count; c += 2) {
+                glm::vec2 b = c + 1 < channel_count ? values[c + 1] : glm::vec2(0.0f);
+                slots[c][m] = values[c] + glm::vec2(-b.y, b.x);
+            }
+        } else {
+            for (int c = 1; c < channel_count; c++) {
+                slots[c][m] = values[c];
+            }
+        }
+    }
+}
+
+void SetSpectrumTestBins(glm::vec2* row, int size, bool mirror) {
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec2(1.0f, 0.0f);
+        if (mirror && i > 0) {
+            row[size - i] = glm::vec2(row[i].x, -row[i].y);
+        }
+    }
+}
+
+// Points are wrapped a block at a time into local arrays, then every lane sums all harmonics for its point
+#define HARMONIC_POINT_BLOCK 64
+
+static void EvaluatePointsScalar(const HarmonicList& harmonics, const glm::vec2* h, int harmonic_count, const float* x, const float* z,
+                                 int begin, int end, float* heights) {
+    for (int i = begin; i < end; i++) {
+        float height = 0.0f;
+        for (int j = 0; j < harmonic_count; j++) {
+            float phase = harmonics.kx[j] * x[i] + harmonics.kz[j] * z[i];
+            height += h[j].x * glm::cos(phase) + h[j].y * glm::sin(phase);
+        }
+        heights[i] = height;
+    }
+}
+
+#if OCEAN_X86
+static int EvaluatePointsSSE2(const HarmonicList& harmonics, const glm::vec2* h, int harmonic_count, const float* x, const float* z,
+                              int begin, int end, float* heights) {
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 height = _mm_setzero_ps();
+        for (int j = 0; j < harmonic_count; j++) {
+            __m128 phase = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(harmonics.kx[j]), px), _mm_mul_ps(_mm_set1_ps(harmonics.kz[j]), pz));
+            __m128 sin, cos;
+            SinCosSSE2(phase, &sin, &cos);
+            height = _mm_add_ps(height, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(h[j].x), cos), _mm_mul_ps(_mm_set1_ps(h[j].y), sin)));
+        }
+        _mm_storeu_ps(heights + i, height);
+    }
+    return i;
+}
+
+OCEAN_TARGET_AVX2 static int EvaluatePointsAVX2(const HarmonicList& harmonics, const glm::vec2* h, int harmonic_count, const float* x, const float* z,
+                                                int begin, int end, float* heights) {
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+        __m256 height = _mm256_setzero_ps();
+        for (int j = 0; j < harmonic_count; j++) {
+            __m256 phase = _mm256_fmadd_ps(_mm256_set1_ps(harmonics.kx[j]), px, _mm256_mul_ps(_mm256_set1_ps(harmonics.kz[j]), pz));
+            __m256 sin, cos;
+            SinCosAVX2(phase, &sin, &cos);
+            height = _mm256_fmadd_ps(_mm256_set1_ps(h[j].x), cos, height);
+            height = _mm256_fmadd_ps(_mm256_set1_ps(h[j].y), sin, height);
+        }
+        _mm256_storeu_ps(heights + i, height);
+    }
+    return i;
+}
+#endif
+
+void EvaluateHarmonics(const HarmonicList& harmonics, int harmonic_count, float t, float period, const glm::vec2* positions, int count, float* heights,
+                       SimdLevel level) {
+    harmonic_count = std::max(0, std::min(harmonic_count, harmonics.count));
+
+    // h(k, t) once per query, shared by every point
+    std::vector<glm::vec2> h(std::max(1, harmonic_count));
+    DirectPhase phase = { t };
+    EvolveRange(harmonics.bins, phase, 0, harmonic_count, h.data(), level);
+
+    float x[HARMONIC_POINT_BLOCK];
+    float z[HARMONIC_POINT_BLOCK];
+    for (int block = 0; block < count; block += HARMONIC_POINT_BLOCK) {
+        int block_count = std::min(HARMONIC_POINT_BLOCK, count - block);
+        for (int i = 0; i < block_count; i++) {
+            glm::vec2 position = positions[block + i];
+            x[i] = position.x - period * glm::floor(position.x / period + 0.5f);
+            z[i] = position.y - period * glm::floor(position.y / period + 0.5f);
+        }
+
+        int i = 0;
+#if OCEAN_X86
+        if (level >= SIMD_LEVEL_AVX2) {
+            i = EvaluatePointsAVX2(harmonics, h.data(), harmonic_count, x, z, i, block_count, heights + block);
+        }
+        if (level >= SIMD_LEVEL_SSE2) {
+            i = EvaluatePointsSSE2(harmonics, h.data(), harmonic_count, x, z, i, block_count, heights + block);
+        }
+#endif
+        EvaluatePointsScalar(harmonics, h.data(), harmonic_count, x, z, i, block_count, heights + block);
+    }
+}
+
+// Weight of every filter tap as a cubic c0 + c1 * f + c2 * f^2 + c3 * f^3 in the fraction f, and its derivative.
+// start is the offset of the first tap from floor(u).
+struct FilterKernel {
+    int start;
+    float weight[4][4];
+    float derivative[4][4];
+};
+
+static const FilterKernel bilinear_kernel = {
+    0,
+    { { 1.0f, -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f } },
+    { { -1.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f, 0.0f } }
+};
+
+// Catmull-Rom
+static const FilterKernel bicubic_kernel = {
+    -1,
+    { { 0.0f, -0.5f, 1.0f, -0.5f }, { 1.0f, 0.0f, -2.5f, 1.5f }, { 0.0f, 0.5f, 2.0f, -1.5f }, { 0.0f, 0.0f, -0.5f, 0.5f } },
+    { { -0.5f, 2.0f, -1.5f, 0.0f }, { 0.0f, -5.0f, 4.5f, 0.0f }, { 0.5f, 4.0f, -4.5f, 0.0f }, { 0.0f, -1.0f, 1.5f, 0.0f } }
+};
+
+static inline float FilterPoly(const float c[4], float f) {
+    return ((c[3] * f + c[2]) * f + c[1]) * f + c[0];
+}
+
+// Brings a texel index in [-size, 2 * size) back into [0, size)
+static inline int WrapTexel(int texel, int size) {
+    texel += texel < 0 ? size : 0;
+    return texel >= size ? texel - size : texel;
+}
+
+template<int Taps>
+static void SampleRangeScalar(const HeightField& field, const FilterKernel& kernel, const glm::vec2* positions, int begin, int end, float* heights,
+                              glm::vec2* gradients) {
+    float scale = field.size / field.length;
+    float size = (float)field.size;
+    float inv_size = 1.0f / size;
+    for (int i = begin; i < end; i++) {
+        float u = positions[i].x * scale;
+        float v = positions[i].y * scale;
+        float u0 = glm::floor(u);
+        float v0 = glm::floor(v);
+        float wu[Taps], dwu[Taps], wv[Taps], dwv[Taps];
+        for (int tap = 0; tap < Taps; tap++) {
+            wu[tap] = FilterPoly(kernel.weight[tap], u - u0);
+            dwu[tap] = FilterPoly(kernel.derivative[tap], u - u0);
+            wv[tap] = FilterPoly(kernel.weight[tap], v - v0);
+            dwv[tap] = FilterPoly(kernel.derivative[tap], v - v0);
+        }
+
+        // The whole texel wrapped into [0, size] up to the rounding of the quotient, exact since u0 and v0 are whole,
+        // so every tap lands in [-size, 2 * size)
+        int row0 = (int)(u0 - size * glm::floor(u0 * inv_size)) + kernel.start;
+        int column0 = (int)(v0 - size * glm::floor(v0 * inv_size)) + kernel.start;
+        float height = 0.0f, du = 0.0f, dv = 0.0f;
+        for (int a = 0; a < Taps; a++) {
+            const float* row = field.heights + WrapTexel(row0 + a, field.size) * field.size;
+            float row_height = 0.0f, row_dv = 0.0f;
+            for (int b = 0; b < Taps; b++) {
+                float texel = row[WrapTexel(column0 + b, field.size)];
+                row_height += wv[b] * texel;
+                row_dv += dwv[b] * texel;
+            }
+            height += wu[a] * row_height;
+            du += dwu[a] * row_height;
+            dv += wu[a] * row_dv;
+        }
+        heights[i] = height;
+        if (gradients) {
+            gradients[i] = glm::vec2(du, dv) * scale;
+        }
+    }
+}
+
+#if OCEAN_X86
+static inline __m128 FilterPolySSE2(const float c[4], __m128 f) {
+    __m128 result = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c[3]), f), _mm_set1_ps(c[2]));
+    result = _mm_add_ps(_mm_mul_ps(result, f), _mm_set1_ps(c[1]));
+    return _mm_add_ps(_mm_mul_ps(result, f), _mm_set1_ps(c[0]));
+}
+
+// floor without sse4.1, truncation rounds negative values up
+static inline __m128 FloorSSE2(__m128 x) {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+// WrapTexel, four lanes at a time
+static inline __m128i WrapTexelsSSE2(__m128i texel, __m128i size) {
+    texel = _mm_add_epi32(texel, _mm_and_si128(_mm_cmplt_epi32(texel, _mm_setzero_si128()), size));
+    return _mm_sub_epi32(texel, _mm_andnot_si128(_mm_cmpgt_epi32(size, texel), size));
+}
+
+template<int Taps>
+static int SampleRangeSSE2(const HeightField& field, const FilterKernel& kernel, const glm::vec2* positions, int begin, int end, float* heights,
+                           glm::vec2* gradients) {
+    __m128 scale = _mm_set1_ps(field.size / field.length);
+    __m128 size_f = _mm_set1_ps((float)field.size);
+    __m128 inv_size = _mm_set1_ps(1.0f / field.size);
+    __m128i size = _mm_set1_epi32(field.size);
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 p01 = _mm_loadu_ps(&positions[i].x);
+        __m128 p23 = _mm_loadu_ps(&positions[i + 2].x);
+        __m128 u = _mm_mul_ps(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0)), scale);
+        __m128 v = _mm_mul_ps(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1)), scale);
+
+        __m128 u0 = FloorSSE2(u);
+        __m128 v0 = FloorSSE2(v);
+
+        __m128 fu = _mm_sub_ps(u, u0);
+        __m128 fv = _mm_sub_ps(v, v0);
+        __m128 wu[Taps], dwu[Taps], wv[Taps], dwv[Taps];
+        for (int tap = 0; tap < Taps; tap++) {
+            wu[tap] = FilterPolySSE2(kernel.weight[tap], fu);
+            dwu[tap] = FilterPolySSE2(kernel.derivative[tap], fu);
+            wv[tap] = FilterPolySSE2(kernel.weight[tap], fv);
+            dwv[tap] = FilterPolySSE2(kernel.derivative[tap], fv);
+        }
+
+        // wrapped the same way as the scalar path
+        u0 = _mm_sub_ps(u0, _mm_mul_ps(size_f, FloorSSE2(_mm_mul_ps(u0, inv_size))));
+        v0 = _mm_sub_ps(v0, _mm_mul_ps(size_f, FloorSSE2(_mm_mul_ps(v0, inv_size))));
+        __m128i row0 = _mm_add_epi32(_mm_cvttps_epi32(u0), _mm_set1_epi32(kernel.start));
+        __m128i column0 = _mm_add_epi32(_mm_cvttps_epi32(v0), _mm_set1_epi32(kernel.start));
+        alignas(16) int rows[Taps][4];
+        alignas(16) int columns[Taps][4];
+        for (int a = 0; a < Taps; a++) {
+            _mm_store_si128((__m128i*)rows[a], WrapTexelsSSE2(_mm_add_epi32(row0, _mm_set1_epi32(a)), size));
+            _mm_store_si128((__m128i*)columns[a], WrapTexelsSSE2(_mm_add_epi32(column0, _mm_set1_epi32(a)), size));
+        }
+
+        __m128 height = _mm_setzero_ps(), du = _mm_setzero_ps(), dv = _mm_setzero_ps();
+        for (int a = 0; a < Taps; a++) {
+            const float* r0 = field.heights + rows[a][0] * field.size;
+            const float* r1 = field.heights + rows[a][1] * field.size;
+            const float* r2 = field.heights + rows[a][2] * field.size;
+            const float* r3 = field.heights + rows[a][3] * field.size;
+            __m128 row_height = _mm_setzero_ps(), row_dv = _mm_setzero_ps();
+            for (int b = 0; b < Taps; b++) {
+                __m128 texel = _mm_setr_ps(r0[columns[b][0]], r1[columns[b][1]], r2[columns[b][2]], r3[columns[b][3]]);
+                row_height = _mm_add_ps(row_height, _mm_mul_ps(wv[b], texel));
+                row_dv = _mm_add_ps(row_dv, _mm_mul_ps(dwv[b], texel));
+            }
+            height = _mm_add_ps(height, _mm_mul_ps(wu[a], row_height));
+            du = _mm_add_ps(du, _mm_mul_ps(dwu[a], row_height));
+            dv = _mm_add_ps(dv, _mm_mul_ps(wu[a], row_dv));
+        }
+        _mm_storeu_ps(heights + i, height);
+        if (gradients) {
+            du = _mm_mul_ps(du, scale);
+            dv = _mm_mul_ps(dv, scale);
+            _mm_storeu_ps(&gradients[i].x, _mm_unpacklo_ps(du, dv));
+            _mm_storeu_ps(&gradients[i + 2].x, _mm_unpackhi_ps(du, dv));
+        }
+    }
+    return i;
+}
+
+OCEAN_TARGET_AVX2 static inline __m256 FilterPolyAVX2(const float c[4], __m256 f) {
+    __m256 result = _mm256_fmadd_ps(_mm256_set1_ps(c[3]), f, _mm256_set1_ps(c[2]));
+    result = _mm256_fmadd_ps(result, f, _mm256_set1_ps(c[1]));
+    return _mm256_fmadd_ps(result, f, _mm256_set1_ps(c[0]));
+}
+
+OCEAN_TARGET_AVX2 static inline __m256i WrapTexelsAVX2(__m256i texel, __m256i size) {
+    texel = _mm256_add_epi32(texel, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), texel), size));
+    return _mm256_sub_epi32(texel, _mm256_andnot_si256(_mm256_cmpgt_epi32(size, texel), size));
+}
+
+template<int Taps>
+OCEAN_TARGET_AVX2 static int SampleRangeAVX2(const HeightField& field, const FilterKernel& kernel, const glm::vec2* positions, int begin, int end,
+                                             float* heights, glm::vec2* gradients) {
+    __m256 scale = _mm256_set1_ps(field.size / field.length);
+    __m256 size_f = _mm256_set1_ps((float)field.size);
+    __m256 inv_size = _mm256_set1_ps(1.0f / field.size);
+    __m256i size = _mm256_set1_epi32(field.size);
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        // shuffle works per 128 bit lane, so put the 64 bit pairs back into order
+        __m256 p0 = _mm256_loadu_ps(&positions[i].x);
+        __m256 p1 = _mm256_loadu_ps(&positions[i + 4].x);
+        __m256 u = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 v = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+        u = _mm256_mul_ps(u, scale);
+        v = _mm256_mul_ps(v, scale);
+        __m256 u0 = _mm256_floor_ps(u);
+        __m256 v0 = _mm256_floor_ps(v);
+
+        __m256 fu = _mm256_sub_ps(u, u0);
+        __m256 fv = _mm256_sub_ps(v, v0);
+        __m256 wu[Taps], dwu[Taps], wv[Taps], dwv[Taps];
+        for (int tap = 0; tap < Taps; tap++) {
+            wu[tap] = FilterPolyAVX2(kernel.weight[tap], fu);
+            dwu[tap] = FilterPolyAVX2(kernel.derivative[tap], fu);
+            wv[tap] = FilterPolyAVX2(kernel.weight[tap], fv);
+            dwv[tap] = FilterPolyAVX2(kernel.derivative[tap], fv);
+        }
+
+        u0 = _mm256_fnmadd_ps(size_f, _mm256_floor_ps(_mm256_mul_ps(u0, inv_size)), u0);
+        v0 = _mm256_fnmadd_ps(size_f, _mm256_floor_ps(_mm256_mul_ps(v0, inv_size)), v0);
+        __m256i row0 = _mm256_add_epi32(_mm256_cvttps_epi32(u0), _mm256_set1_epi32(kernel.start));
+        __m256i column0 = _mm256_add_epi32(_mm256_cvttps_epi32(v0), _mm256_set1_epi32(kernel.start));
+        __m256i columns[Taps];
+        for (int b = 0; b < Taps; b++) {
+            columns[b] = WrapTexelsAVX2(_mm256_add_epi32(column0, _mm256_set1_epi32(b)), size);
+        }
+
+        __m256 height = _mm256_setzero_ps(), du = _mm256_setzero_ps(), dv = _mm256_setzero_ps();
+        for (int a = 0; a < Taps; a++) {
+            __m256i row = _mm256_mullo_epi32(WrapTexelsAVX2(_mm256_add_epi32(row0, _mm256_set1_epi32(a)), size), size);
+            __m256 row_height = _mm256_setzero_ps(), row_dv = _mm256_setzero_ps();
+            for (int b = 0; b < Taps; b++) {
+                __m256 texel = _mm256_i32gather_ps(field.heights, _mm256_add_epi32(row, columns[b]), 4);
+                row_height = _mm256_fmadd_ps(wv[b], texel, row_height);
+                row_dv = _mm256_fmadd_ps(dwv[b], texel, row_dv);
+            }
+            height = _mm256_fmadd_ps(wu[a], row_height, height);
+            du = _mm256_fmadd_ps(dwu[a], row_height, du);
+            dv = _mm256_fmadd_ps(wu[a], row_dv, dv);
+        }
+        _mm256_storeu_ps(heights + i, height);
+        if (gradients) {
+            du = _mm256_mul_ps(du, scale);
+            dv = _mm256_mul_ps(dv, scale);
+            __m256 lo = _mm256_unpacklo_ps(du, dv);
+            __m256 hi = _mm256_unpackhi_ps(du, dv);
+            _mm256_storeu_ps(&gradients[i].x, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(&gradients[i + 4].x, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+    }
+    return i;
+}
+#endif
+
+template<int Taps>
+static void SampleRange(const HeightField& field, const FilterKernel& kernel, const glm::vec2* positions, int begin, int end, float* heights,
+                        glm::vec2* gradients, SimdLevel level) {
+    int i = begin;
+#if OCEAN_X86
+    if (level >= SIMD_LEVEL_AVX2) {
+        i = SampleRangeAVX2<Taps>(field, kernel, positions, i, end, heights, gradients);
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        i = SampleRangeSSE2<Taps>(field, kernel, positions, i, end, heights, gradients);
+    }
+#endif
+    SampleRangeScalar<Taps>(field, kernel, positions, i, end, heights, gradients);
+}
+
+void SampleHeightField(const HeightField& field, HeightFilter filter, const glm::vec2* positions, int begin, int end, float* heights, glm::vec2* gradients,
+                       SimdLevel level) {
+    if (filter == HEIGHT_FILTER_BICUBIC) {
+        SampleRange<4>(field, bicubic_kernel, positions, begin, end, heights, gradients, level);
+    } else {
+        SampleRange<2>(field, bilinear_kernel, positions, begin, end, heights, gradients, level);
+    }
+}
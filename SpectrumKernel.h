@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm.hpp>
+
+enum SimdLevel {
+    SIMD_LEVEL_SCALAR = 0,
+    SIMD_LEVEL_SSE2,
+    SIMD_LEVEL_AVX2
+};
+
+// Structure-of-arrays spectrum layout, one float per bin in each array.
+// h0 holds h0(k), h0_conj holds conj(h0(-k)) and omega holds the dispersion table.
+struct SpectrumData {
+    float* h0_re = nullptr;
+    float* h0_im = nullptr;
+    float* h0_conj_re = nullptr;
+    float* h0_conj_im = nullptr;
+    float* omega = nullptr;
+};
+
+// Fields transformed alongside the heights, all derived from h(k, t). Displacement is the choppy i * k / |k| * h,
+// slope the gradient -i * k * h of the surface Re(sum of h(k, t) * e^(-i * k . (x, z))).
+enum SpectrumChannel {
+    SPECTRUM_CHANNEL_HEIGHT = 0,
+    SPECTRUM_CHANNEL_DISPLACEMENT_X,
+    SPECTRUM_CHANNEL_DISPLACEMENT_Z,
+    SPECTRUM_CHANNEL_SLOPE_X,
+    SPECTRUM_CHANNEL_SLOPE_Z,
+    SPECTRUM_CHANNEL_COUNT
+};
+
+enum HeightFilter {
+    HEIGHT_FILTER_BILINEAR = 0,
+    HEIGHT_FILTER_BICUBIC
+};
+
+// Periodic size x size grid of real heights over length x length world units, texel (a, b) sits at (x, z) = (a, b) * length / size.
+struct HeightField {
+    const float* heights = nullptr;
+    int size = 0;
+    float length = 0.0f;
+};
+
+// Compacted list of the bins that survive pruning, in the same layout as SpectrumData with h0_conj always filled.
+// Entry i evolves into out[index[i]], every other output slot is left untouched.
+struct SparseSpectrum {
+    SpectrumData bins;
+    int* index = nullptr;
+    int count = 0;
+};
+
+// Spectrum bins in descending energy for evaluating the surface directly, k is in radians per unit length.
+struct HarmonicList {
+    SpectrumData bins;
+    float* kx = nullptr;
+    float* kz = nullptr;
+    int count = 0;
+};
+
+// cos/sin(omega * t) for every whole omega in [0, count). Dispersion quantizes omega to whole numbers,
+// so one table per frame replaces the per-bin transcendentals with a lookup.
+struct PhaseTable {
+    float* cos_table = nullptr;
+    float* sin_table = nullptr;
+    int count = 0;
+};
+
+// Highest instruction set supported by the running cpu, detected once.
+SimdLevel GetSimdLevel();
+
+// Evolves bins [begin, end) of the spectrum to time t and writes h(k, t) to out[begin, end).
+// The SIMD paths use a polynomial sincos that stays within 2 ulp of glm::cos/glm::sin for |omega * t| < 8192,
+// so the result matches the scalar path to about 1e-6 * (|h0| + |h0_conj|) per bin.
+void EvolveSpectrum(const SpectrumData& data, float t, int begin, int end, glm::vec2* out, SimdLevel level = GetSimdLevel());
+
+// Evolves rows [row_begin, row_end) of a hermitian half spectrum. h0 holds the full size * size plane and h0_conj is unused,
+// conj(h0(-k)) is read from the mirrored bin instead. omega and out hold size / 2 + 1 bins per row.
+// With pack_nyquist the out rows are size / 2 wide and bin 0 holds h(n, 0) + i * h(n, size / 2), both of whose column dfts are real.
+void EvolveHalfSpectrum(const SpectrumData& data, float t, int size, int row_begin, int row_end, glm::vec2* out, bool pack_nyquist,
+                        SimdLevel level = GetSimdLevel());
+
+// Fills the table for time t with the same float arguments as the direct path, so lookups match glm::cos/glm::sin exactly.
+void BuildPhaseTable(float t, PhaseTable& table);
+
+// Table driven variants of the kernels above, every omega must be a whole number below table.count.
+void EvolveSpectrum(const SpectrumData& data, const PhaseTable& table, int begin, int end, glm::vec2* out, SimdLevel level = GetSimdLevel());
+
+void EvolveHalfSpectrum(const SpectrumData& data, const PhaseTable& table, int size, int row_begin, int row_end, glm::vec2* out, bool pack_nyquist,
+                        SimdLevel level = GetSimdLevel());
+
+// Evolves row n of the full size x size spectrum over length x length world units and derives the first channel_count channels
+// from it while the row is still in cache. Channel c of bin m goes to out[c * channel_stride + m], channel 0 is the height.
+// With pack two real fields share one complex dft: channels 2 * i and 2 * i + 1 go to out[i * channel_stride + m] as A + i * B
+// and come out as its real and imaginary part. B only stays clean when the height spectrum is hermitian.
+void EvolveSpectrumChannels(const SpectrumData& data, float t, int size, float length, int n, int channel_count, glm::vec2* out,
+                            size_t channel_stride, bool pack, SimdLevel level = GetSimdLevel());
+
+void EvolveSpectrumChannels(const SpectrumData& data, const PhaseTable& table, int size, float length, int n, int channel_count, glm::vec2* out,
+                            size_t channel_stride, bool pack, SimdLevel level = GetSimdLevel());
+
+// Same derivation for a row n whose heights are already in out[0, size). The nyquist row and column are their own mirrors,
+// their odd derivatives are left zero so the channels of a hermitian height spectrum stay hermitian.
+void DeriveSpectrumChannels(int size, float length, int n, int channel_count, glm::vec2* out, size_t channel_stride, bool pack);
+
+// Test: forces bins 0 to 3 of row 0 of the heights to (1, 0), call it before the other channels are derived. With mirror (full plane)
+// bins size - 1 to size - 3 get the conjugates, so the spectrum stays hermitian and packed channels do not leak into each other.
+void SetSpectrumTestBins(glm::vec2* row, int size, bool mirror);
+
+// Picks the most energetic bins of a size x columns spectrum until they hold target_energy, ties by bin so the set does not depend
+// on the sort. With mirror_pairs (full plane, columns == size) bin k and its mirror -k are ranked once by their summed energy and kept
+// or dropped together, so a hermitian spectrum stays hermitian. Writes the kept bins in ascending order to kept, which must hold
+// size * columns entries, adds their energy to kept_energy and returns how many there are.
+int SelectSpectrumBins(const float* energy, int size, int columns, bool mirror_pairs, double target_energy, int* kept, double* kept_energy);
+
+// Evolves entries [begin, end) of a sparse list and scatters them into out.
+void EvolveSparseSpectrum(const SparseSpectrum& sparse, float t, int begin, int end, glm::vec2* out, SimdLevel level = GetSimdLevel());
+
+void EvolveSparseSpectrum(const SparseSpectrum& sparse, const PhaseTable& table, int begin, int end, glm::vec2* out, SimdLevel level = GetSimdLevel());
+
+// heights[i] = Re(sum of h(k, t) * e^(-i * k . (x, z)) over the first harmonic_count harmonics) at positions[i] = (x, z).
+// Positions are wrapped into [-period / 2, period / 2) first, period must be a whole number of wavelengths of every harmonic.
+void EvaluateHarmonics(const HarmonicList& harmonics, int harmonic_count, float t, float period, const glm::vec2* positions, int count, float* heights,
+                       SimdLevel level = GetSimdLevel());
+
+// Samples the height field at positions [begin, end), given as world (x, z) and wrapped over length. Bicubic is Catmull-Rom.
+// gradients receives (dh/dx, dh/dz) when not null.
+void SampleHeightField(const HeightField& field, HeightFilter filter, const glm::vec2* positions, int begin, int end, float* heights, glm::vec2* gradients,
+                       SimdLevel level = GetSimdLevel());
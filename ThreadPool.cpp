@@ -0,0 +1,83 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int thread_count) : next_block(0) {
+    if (thread_count <= 0) {
+        thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    for (int i = 1; i < thread_count; i++) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    work_cv.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(int count, int grain, const Job& in_job) {
+    grain = std::max(1, grain);
+    if (workers.empty() || count <= grain) {
+        if (count > 0) {
+            in_job(0, count);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &in_job;
+        job_count = count;
+        job_grain = grain;
+        block_count = (count + grain - 1) / grain;
+        next_block = 0;
+        active_workers = (int)workers.size();
+        generation++;
+    }
+    work_cv.notify_all();
+
+    RunBlocks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return active_workers == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::WorkerLoop() {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [&] { return quit || generation != seen_generation; });
+            if (quit) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        RunBlocks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active_workers == 0) {
+            done_cv.notify_one();
+        }
+    }
+}
+
+void ThreadPool::RunBlocks() {
+    int block;
+    while ((block = next_block.fetch_add(1)) < block_count) {
+        int begin = block * job_grain;
+        int end = std::min(job_count, begin + job_grain);
+        (*job)(begin, end);
+    }
+}
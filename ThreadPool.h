@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    typedef std::function<void(int begin, int end)> Job;
+
+    // thread_count counts the calling thread, 0 picks one thread per hardware core.
+    explicit ThreadPool(int thread_count = 0);
+
+    ~ThreadPool();
+
+    int GetThreadCount() const { return (int)workers.size() + 1; }
+
+    // Splits [0, count) into blocks of grain items and runs them on the workers and the calling thread.
+    // Returns once every block is done. Only one ParallelFor may be in flight at a time.
+    void ParallelFor(int count, int grain, const Job& job);
+
+private:
+    void WorkerLoop();
+
+    void RunBlocks();
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    const Job* job = nullptr;
+    int job_count = 0;
+    int job_grain = 1;
+    int block_count = 0;
+    std::atomic<int> next_block;
+    int active_workers = 0;
+    uint64_t generation = 0;
+    bool quit = false;
+};
@@ -1,39 +1,160 @@
 #include "WavesGenerator.h"
 
+#include <algorithm>
+#include <numeric>
+
 #define USE_GPU_FFT 1
 
-WavesGenerator::WavesGenerator(Context* in_context, int in_size, int in_length) {
+// Evolve only the hermitian half plane and run a complex-to-real inverse, the height field is real anyway.
+// conj(h0(-k)) comes from the mirrored bin instead of an independent draw, so the ocean differs from the full plane mode.
+#define USE_HALF_SPECTRUM 0
+
+// Cpu fft of the full plane: evolve each spectrum row right into the first row dft instead of through height_data,
+// which saves writing and reading back the whole spectrum grid every frame
+#define USE_FUSED_EVOLUTION 1
+
+// Also transform the choppy displacement and slope fields of the full plane, derived from the heights in the evolution loop
+// and batched with them through one fft. The half spectrum and the baked loop only produce heights.
+#define USE_DERIVED_CHANNELS 1
+
+// Two real channels per complex fft, as the real and imaginary part of one map. Needs the hermitian part of the spectrum
+// in the tables, whose real transform is the same height field.
+#define USE_PACKED_CHANNELS 1
+
+#define HERMITIAN_TABLES (USE_DERIVED_CHANNELS && USE_PACKED_CHANNELS && !USE_HALF_SPECTRUM)
+
+// Rows per thread block, sized so the spectrum and output rows of one block stay in L2
+#define BLOCK_CACHE_BYTES (256 * 1024)
+
+// Only spectrum model so far, part of the cache key so a new model never maps old tables
+#define SPECTRUM_MODEL_PHILLIPS 0
+
+// Upper bound of the harmonics kept for EvaluateHeights
+#define MAX_HARMONICS 65536
+
+// Points per thread block in SampleHeights
+#define SAMPLE_GRAIN 4096
+
+WavesGenerator::WavesGenerator(Context* in_context, int in_size, int in_length, ThreadPool* in_thread_pool, uint32_t in_seed,
+                               const std::string& cache_directory) {
     context = in_context;
     size = in_size;
     length = in_length;
+    seed = in_seed;
+
+    thread_pool = in_thread_pool;
+    if (!thread_pool) {
+        thread_pool = new ThreadPool();
+        owns_thread_pool = true;
+    }
+#if USE_DERIVED_CHANNELS && !USE_HALF_SPECTRUM
+    channel_count = SPECTRUM_CHANNEL_COUNT;
+#endif
+#if HERMITIAN_TABLES
+    channels_per_map = 2;
+#endif
+    map_count = (channel_count + channels_per_map - 1) / channels_per_map;
+    int row_bytes = size * (5 * sizeof(float) + map_count * sizeof(glm::vec2));
+    block_rows = std::max(1, BLOCK_CACHE_BYTES / row_bytes);
 
     // init params
     wave_amp = 0.0003f;
     wind_speed = glm::vec2(32.0f, 32.0f);
 
-    dispersion_table = new float[size * size];
-    spectrum = new glm::vec2[size * size];
-    spectrum_conj = new glm::vec2[size * size];
-    height_data = new glm::vec2[size * size];
-
-    for (int n = 0; n < size; n++) {
-        for (int m = 0; m < size; m++) {
-            int index = n * size + m;
+    SpectrumCacheKey cache_key;
+    cache_key.size = size;
+    cache_key.length = length;
+    cache_key.wind_speed_x = wind_speed.x;
+    cache_key.wind_speed_y = wind_speed.y;
+    cache_key.wave_amp = wave_amp;
+    cache_key.seed = seed;
+    cache_key.model = SPECTRUM_MODEL_PHILLIPS;
+    cache_key.layout = USE_HALF_SPECTRUM ? 1 : HERMITIAN_TABLES * 2;
+
+#if USE_HALF_SPECTRUM
+    int half = size / 2;
+    size_t spectrum_floats = (size_t)size * size * 2 + (size_t)size * (half + 1);
+#else
+    size_t spectrum_floats = (size_t)size * size * 5;
+#endif
 
-            dispersion_table[index] = Dispersion(n, m);
+    // a previous run with the same parameters left the tables on disk, map them instead of deriving them again
+    float* spectrum_base = cache_directory.empty() ? nullptr : spectrum_cache.Map(cache_directory, cache_key, spectrum_floats);
+    bool cached = spectrum_base != nullptr;
+    if (!cached) {
+        spectrum_storage = new float[spectrum_floats];
+        spectrum_base = spectrum_storage;
+    }
 
-            spectrum[index] = InitSpectrum(n, m);
+#if USE_HALF_SPECTRUM
+    spectrum.h0_re = spectrum_base;
+    spectrum.h0_im = spectrum.h0_re + size * size;
+    spectrum.omega = spectrum.h0_im + size * size;
+    height_data = new glm::vec2[size * (half + 1)];
+#else
+    spectrum.h0_re = spectrum_base;
+    spectrum.h0_im = spectrum.h0_re + size * size;
+    spectrum.h0_conj_re = spectrum.h0_im + size * size;
+    spectrum.h0_conj_im = spectrum.h0_conj_re + size * size;
+    spectrum.omega = spectrum.h0_conj_im + size * size;
+    height_data = new glm::vec2[size * size * map_count];
+#endif
 
-            spectrum_conj[index] = InitSpectrum(-n, -m);
-            spectrum_conj[index].y *= -1.0f;
+    if (!cached) {
+        InitTables();
+        if (!cache_directory.empty()) {
+            SpectrumCache::Store(cache_directory, cache_key, spectrum_storage, spectrum_floats);
         }
     }
 
+#if USE_HALF_SPECTRUM
+    prune_stats.total_bins = size * (half + 1);
+#else
+    prune_stats.total_bins = size * size;
+#endif
+    prune_stats.kept_bins = prune_stats.total_bins;
+
+    // Dispersion floors omega, so when every value is whole the per frame phases reduce to one cos/sin per distinct omega
+#if USE_HALF_SPECTRUM
+    int omega_count = size * (size / 2 + 1);
+#else
+    int omega_count = size * size;
+#endif
+    float max_omega = 0.0f;
+    bool quantized = true;
+    for (int i = 0; i < omega_count; i++) {
+        float omega = spectrum.omega[i];
+        quantized = quantized && omega >= 0.0f && omega == glm::floor(omega);
+        max_omega = std::max(max_omega, omega);
+    }
+    if (quantized) {
+        phase_table.count = (int)max_omega + 1;
+        phase_storage = new float[phase_table.count * 2];
+        phase_table.cos_table = phase_storage;
+        phase_table.sin_table = phase_storage + phase_table.count;
+    }
+
 #if USE_GPU_FFT
-    fft = new FourierTransform(context, size);
+    fft = new FourierTransform(context, size, USE_HALF_SPECTRUM, map_count);
+#else
+    fft_out = new glm::vec2[size * size * map_count];
+    sample_heights = new float[size * size];
+    std::fill(sample_heights, sample_heights + size * size, 0.0f);
+    // kernels measured on this host are kept next to the spectrum cache, so later starts plan without timing them again
+    std::string wisdom_path = cache_directory.empty() ? "" : cache_directory + "/am_fft.wisdom";
+    if (!wisdom_path.empty()) {
+        am_fft_wisdom_load(wisdom_path.c_str());
+    }
+#if USE_HALF_SPECTRUM
+    fft_plan = am_fft_plan_2d_c2r(AM_FFT_FORWARD | AM_FFT_MEASURE, size, size);
 #else
-    fft_out = new glm::vec2[size * size];
-    fft_plan = am_fft_plan_2d(0, size, size);
+    // All channels run through the batched functions, which take their buffers from fft_scratch
+    fft_plan = am_fft_plan_2d(AM_FFT_FORWARD | AM_FFT_MEASURE | AM_FFT_NO_SCRATCH, size, size);
+    fft_scratch = new glm::vec2[am_fft_2d_batch_scratch_size(fft_plan, map_count)];
+#endif
+    if (!wisdom_path.empty()) {
+        am_fft_wisdom_save(wisdom_path.c_str());
+    }
 #endif
 
     blast::GfxTextureDesc texture_desc;
@@ -43,32 +164,117 @@ WavesGenerator::WavesGenerator(Context* in_context, int in_size, int in_length)
     texture_desc.mem_usage = blast::MEMORY_USAGE_GPU_ONLY;
     texture_desc.res_usage = blast::RESOURCE_USAGE_SHADER_RESOURCE | blast::RESOURCE_USAGE_UNORDERED_ACCESS;
     height_map = context->device->CreateTexture(texture_desc);
+    output_map = height_map;
+    channel_maps[SPECTRUM_CHANNEL_HEIGHT] = height_map;
+    for (int c = 1; c < map_count; c++) {
+        channel_maps[c] = context->device->CreateTexture(texture_desc);
+    }
+
+#if USE_GPU_FFT && USE_HALF_SPECTRUM
+    texture_desc.width = size / 2;
+    spectrum_map = context->device->CreateTexture(texture_desc);
+#endif
 }
 
 WavesGenerator::~WavesGenerator() {
-    SAFE_DELETE_ARRAY(dispersion_table);
+    ClearLoop();
+    ClearSparse();
+
+    SAFE_DELETE_ARRAY(spectrum_storage);
+    SAFE_DELETE_ARRAY(phase_storage);
+    SAFE_DELETE_ARRAY(harmonic_storage);
     SAFE_DELETE_ARRAY(height_data);
-    SAFE_DELETE_ARRAY(spectrum);
-    SAFE_DELETE_ARRAY(spectrum_conj);
 
 #if USE_GPU_FFT
     SAFE_DELETE(fft);
 #else
     SAFE_DELETE_ARRAY(fft_out);
+    SAFE_DELETE_ARRAY(fft_scratch);
+    SAFE_DELETE_ARRAY(sample_heights);
     am_fft_plan_2d_free(fft_plan);
 #endif
     context->device->DestroyTexture(height_map);
+    for (int c = 1; c < map_count; c++) {
+        context->device->DestroyTexture(channel_maps[c]);
+    }
+    if (spectrum_map) {
+        context->device->DestroyTexture(spectrum_map);
+    }
+
+    if (owns_thread_pool) {
+        SAFE_DELETE(thread_pool);
+    }
+}
+
+void WavesGenerator::InitTables() {
+#if USE_HALF_SPECTRUM
+    int half = size / 2;
+
+    // every bin draws from its own philox counter, so rows can be filled in any order on any thread
+    thread_pool->ParallelFor(size, block_rows, [&](int row_begin, int row_end) {
+        for (int n = row_begin; n < row_end; n++) {
+            for (int m = 0; m < size; m++) {
+                int index = n * size + m;
+
+                glm::vec2 h0 = InitSpectrum(n, m, 0);
+                spectrum.h0_re[index] = h0.x;
+                spectrum.h0_im[index] = h0.y;
+
+                if (m <= half) {
+                    spectrum.omega[n * (half + 1) + m] = Dispersion(n, m);
+                }
+            }
+        }
+    });
+#else
+    // every bin draws from its own philox counter, so rows can be filled in any order on any thread
+    thread_pool->ParallelFor(size, block_rows, [&](int row_begin, int row_end) {
+        for (int n = row_begin; n < row_end; n++) {
+            for (int m = 0; m < size; m++) {
+                int index = n * size + m;
+
+                spectrum.omega[index] = Dispersion(n, m);
+
+                glm::vec2 h0 = InitSpectrum(n, m, 0);
+                spectrum.h0_re[index] = h0.x;
+                spectrum.h0_im[index] = h0.y;
+
+                glm::vec2 h0_conj = InitSpectrum(-n, -m, 1);
+#if HERMITIAN_TABLES
+                // Average with the draws of the mirrored bin, so h(-k, t) = conj(h(k, t)). The real part of the transform,
+                // which is all the height map uses, stays the same.
+                int mirror_n = (size - n) % size;
+                int mirror_m = (size - m) % size;
+                h0 = 0.5f * (h0 + InitSpectrum(-mirror_n, -mirror_m, 1));
+                h0_conj = 0.5f * (h0_conj + InitSpectrum(mirror_n, mirror_m, 0));
+                spectrum.h0_re[index] = h0.x;
+                spectrum.h0_im[index] = h0.y;
+#endif
+                spectrum.h0_conj_re[index] = h0_conj.x;
+                spectrum.h0_conj_im[index] = -h0_conj.y;
+            }
+        }
+    });
+#endif
+}
+
+void WavesGenerator::GetBin(int n, int m, glm::vec2* h0, glm::vec2* h0_conj) {
+    int index = n * size + m;
+    *h0 = glm::vec2(spectrum.h0_re[index], spectrum.h0_im[index]);
+#if USE_HALF_SPECTRUM
+    int mirror_index = ((size - n) % size) * size + (size - m) % size;
+    *h0_conj = glm::vec2(spectrum.h0_re[mirror_index], -spectrum.h0_im[mirror_index]);
+#else
+    *h0_conj = glm::vec2(spectrum.h0_conj_re[index], spectrum.h0_conj_im[index]);
+#endif
 }
 
-glm::vec2 WavesGenerator::RandomVariable() {
-    float x1, x2, w;
-    do {
-        x1 = 2.f * UniformRandomVariable() - 1.f;
-        x2 = 2.f * UniformRandomVariable() - 1.f;
-        w = x1 * x1 + x2 * x2;
-    } while ( w >= 1.f );
-    w = sqrt((-2.f * log(w)) / w);
-    return glm::vec2(x1 * w, x2 * w);
+void WavesGenerator::ParallelFft(void* scheduler, am_fft_task_t task, void* data, unsigned int count) {
+    ((ThreadPool*)scheduler)->ParallelFor((int)count, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            task(data, (unsigned int)i);
+        }
+    });
 }
 
 float WavesGenerator::Dispersion(int n, int m) {
@@ -98,73 +304,423 @@ float WavesGenerator::PhillipsSpectrum(int n, int m) {
     return wave_amp * glm::exp(-1.0f / (k_length2 * L2)) / k_length4 * k_dot_w2 * glm::exp(-k_length2 * l2);
 }
 
-glm::vec2 WavesGenerator::InitSpectrum(int n, int m) {
-    glm::vec2 r = RandomVariable();
+glm::vec2 WavesGenerator::InitSpectrum(int n, int m, int stream) {
+    glm::vec2 r = GaussianPair(seed, n, m, stream);
     return r * glm::sqrt(PhillipsSpectrum(n, m) / 2.0f);
 }
 
-glm::vec2 WavesGenerator::UpdateSpectrum(float t, int n, int m) {
-    int index = n * size + m;
+void WavesGenerator::PruneSpectrum(float energy_fraction) {
+    ClearSparse();
 
-    float omegat = dispersion_table[index] * t;
+    int half = size / 2;
+#if USE_HALF_SPECTRUM
+    int columns = half + 1;
+    // the gpu transform takes the nyquist column packed into column 0, so the edge columns go through edge_data
+    bool pack_nyquist = USE_GPU_FFT;
+    int out_stride = pack_nyquist ? half : half + 1;
+#else
+    int columns = size;
+    bool pack_nyquist = false;
+    int out_stride = size;
+#endif
+    int bin_count = size * columns;
 
-    float cos = glm::cos(omegat);
-    float sin = glm::sin(omegat);
+    std::vector<float> energy(bin_count);
+    double total_energy = 0.0;
+    for (int n = 0; n < size; n++) {
+        for (int m = 0; m < columns; m++) {
+            glm::vec2 h0, h0_conj;
+            GetBin(n, m, &h0, &h0_conj);
+            energy[n * columns + m] = glm::dot(h0, h0) + glm::dot(h0_conj, h0_conj);
+            total_energy += energy[n * columns + m];
+        }
+    }
 
-    float c0a = spectrum[index].x*cos - spectrum[index].y*sin;
-    float c0b = spectrum[index].x*sin + spectrum[index].y*cos;
+    prune_stats.total_bins = bin_count;
+    prune_stats.kept_bins = bin_count;
+    prune_stats.retained_energy = 1.0f;
+    if (energy_fraction >= 1.0f || total_energy <= 0.0) {
+        return;
+    }
 
-    float c1a = spectrum_conj[index].x*cos - spectrum_conj[index].y*-sin;
-    float c1b = spectrum_conj[index].x*-sin + spectrum_conj[index].y*cos;
+    // The packed channels need h(-k) = conj(h(k)) to hold after pruning too, so mirrored bins go together
+    std::vector<int> order(bin_count);
+    double target_energy = std::max(0.0f, energy_fraction) * total_energy;
+    double kept_energy = 0.0;
+    int kept_count = SelectSpectrumBins(energy.data(), size, columns, HERMITIAN_TABLES, target_energy, order.data(), &kept_energy);
+
+    auto is_edge = [&](int bin) {
+        int m = bin % columns;
+        return pack_nyquist && (m == 0 || m == half);
+    };
+    int edge_count = (int)std::count_if(order.begin(), order.begin() + kept_count, is_edge);
+    std::stable_partition(order.begin(), order.begin() + kept_count, [&](int bin) { return !is_edge(bin); });
+
+    sparse_storage = new float[std::max(1, kept_count) * 5];
+    sparse_index_storage = new int[std::max(1, kept_count)];
+    sparse.bins.h0_re = sparse_storage;
+    sparse.bins.h0_im = sparse.bins.h0_re + kept_count;
+    sparse.bins.h0_conj_re = sparse.bins.h0_im + kept_count;
+    sparse.bins.h0_conj_im = sparse.bins.h0_conj_re + kept_count;
+    sparse.bins.omega = sparse.bins.h0_conj_im + kept_count;
+    sparse.index = sparse_index_storage;
+    sparse.count = kept_count - edge_count;
+
+    for (int i = 0; i < kept_count; i++) {
+        int n = order[i] / columns;
+        int m = order[i] % columns;
+        glm::vec2 h0, h0_conj;
+        GetBin(n, m, &h0, &h0_conj);
+        sparse.bins.h0_re[i] = h0.x;
+        sparse.bins.h0_im[i] = h0.y;
+        sparse.bins.h0_conj_re[i] = h0_conj.x;
+        sparse.bins.h0_conj_im[i] = h0_conj.y;
+        sparse.bins.omega[i] = spectrum.omega[n * columns + m];
+        sparse.index[i] = is_edge(order[i]) ? n * 2 + (m == half ? 1 : 0) : n * out_stride + m;
+    }
 
-    return glm::vec2(c0a+c1a, c0b+c1b);
+    sparse_edges.bins.h0_re = sparse.bins.h0_re + sparse.count;
+    sparse_edges.bins.h0_im = sparse.bins.h0_im + sparse.count;
+    sparse_edges.bins.h0_conj_re = sparse.bins.h0_conj_re + sparse.count;
+    sparse_edges.bins.h0_conj_im = sparse.bins.h0_conj_im + sparse.count;
+    sparse_edges.bins.omega = sparse.bins.omega + sparse.count;
+    sparse_edges.index = sparse.index + sparse.count;
+    sparse_edges.count = edge_count;
+    if (pack_nyquist) {
+        edge_data = new glm::vec2[size * 2];
+        std::fill(edge_data, edge_data + size * 2, glm::vec2(0.0f));
+    }
+
+    // pruned bins are never written again
+    std::fill(height_data, height_data + size * out_stride, glm::vec2(0.0f));
+    sparse_active = true;
+
+    prune_stats.kept_bins = kept_count;
+    prune_stats.retained_energy = (float)(kept_energy / total_energy);
 }
 
-void WavesGenerator::Update(blast::GfxCommandBuffer* cmd , float t) {
-    float kx, kz;
-    int index;
+void WavesGenerator::EvaluateHeights(const glm::vec2* positions, int count, float t, int harmonic_count, float* heights) {
+    std::call_once(harmonics_once, [this]() { BuildHarmonics(); });
+    EvaluateHarmonics(harmonics, harmonic_count, t, (float)length, positions, count, heights);
+}
 
-    for (int n = 0; n < size; n++) {
-        kx = PI * (2.0f * n - size) / length;
+bool WavesGenerator::SampleHeights(const glm::vec2* positions, int count, HeightFilter filter, float* heights, glm::vec2* gradients) {
+#if USE_GPU_FFT
+    return false;
+#else
+    HeightField field;
+    field.heights = sample_heights;
+    field.size = size;
+    field.length = (float)length;
+    thread_pool->ParallelFor(count, SAMPLE_GRAIN, [&](int begin, int end) {
+        SampleHeightField(field, filter, positions, begin, end, heights, gradients);
+    });
+    return true;
+#endif
+}
 
+void WavesGenerator::BuildHarmonics() {
+    // every bin of the full plane, the half spectrum mode has the mirrored ones implicitly
+    int bin_count = size * size;
+    std::vector<float> energy(bin_count);
+    for (int n = 0; n < size; n++) {
         for (int m = 0; m < size; m++) {
-            kz = PI*(2 * m - size) / length;
-            index = n * size + m;
-            height_data[index] = UpdateSpectrum(t, n, m);
+            glm::vec2 h0, h0_conj;
+            GetBin(n, m, &h0, &h0_conj);
+            energy[n * size + m] = glm::dot(h0, h0) + glm::dot(h0_conj, h0_conj);
         }
     }
 
-    // Test
-    height_data[0] = glm::vec2(1.0, 0.0);
-    height_data[1] = glm::vec2(1.0, 0.0);
-    height_data[2] = glm::vec2(1.0, 0.0);
-    height_data[3] = glm::vec2(1.0, 0.0);
+    std::vector<int> order(bin_count);
+    std::iota(order.begin(), order.end(), 0);
+    auto more_energy = [&](int a, int b) {
+        return energy[a] > energy[b] || (energy[a] == energy[b] && a < b);
+    };
+    int count = std::min(bin_count, MAX_HARMONICS);
+    std::partial_sort(order.begin(), order.begin() + count, order.end(), more_energy);
+    while (count > 0 && energy[order[count - 1]] <= 0.0f) {
+        count--;
+    }
 
-#if USE_GPU_FFT
-    blast::GfxTextureBarrier barrier;
-    barrier.texture = height_map;
-    barrier.new_state = blast::RESOURCE_STATE_COPY_DEST;
-    context->device->SetBarrier(cmd, 0, nullptr, 1, &barrier);
+    harmonic_storage = new float[std::max(1, count) * 7];
+    harmonics.bins.h0_re = harmonic_storage;
+    harmonics.bins.h0_im = harmonics.bins.h0_re + count;
+    harmonics.bins.h0_conj_re = harmonics.bins.h0_im + count;
+    harmonics.bins.h0_conj_im = harmonics.bins.h0_conj_re + count;
+    harmonics.bins.omega = harmonics.bins.h0_conj_im + count;
+    harmonics.kx = harmonics.bins.omega + count;
+    harmonics.kz = harmonics.kx + count;
+    harmonics.count = count;
+
+    for (int i = 0; i < count; i++) {
+        int n = order[i] / size;
+        int m = order[i] % size;
+        glm::vec2 h0, h0_conj;
+        GetBin(n, m, &h0, &h0_conj);
+        harmonics.bins.h0_re[i] = h0.x;
+        harmonics.bins.h0_im[i] = h0.y;
+        harmonics.bins.h0_conj_re[i] = h0_conj.x;
+        harmonics.bins.h0_conj_im[i] = h0_conj.y;
+        harmonics.bins.omega[i] = Dispersion(n, m);
+        harmonics.kx[i] = PI * (2.0f * n - size) / length;
+        harmonics.kz[i] = PI * (2.0f * m - size) / length;
+    }
+}
+
+void WavesGenerator::ClearSparse() {
+    SAFE_DELETE_ARRAY(sparse_storage);
+    SAFE_DELETE_ARRAY(sparse_index_storage);
+    SAFE_DELETE_ARRAY(edge_data);
+    sparse = SparseSpectrum();
+    sparse_edges = SparseSpectrum();
+    sparse_active = false;
+    prune_stats.kept_bins = prune_stats.total_bins;
+    prune_stats.retained_energy = 1.0f;
+}
+
+void WavesGenerator::Update(blast::GfxCommandBuffer* cmd , float t) {
+    if (!loop_frames.empty()) {
+        PlayLoop(cmd, t);
+        return;
+    }
+    Simulate(cmd, t);
+}
+
+bool WavesGenerator::BakeLoop(blast::GfxCommandBuffer* cmd, int frame_count, int resolution, bool blend_frames) {
+    if (phase_table.count == 0 || frame_count <= 0 || resolution <= 0 || resolution > size || size % resolution != 0) {
+        return false;
+    }
+    ClearLoop();
+
+    blast::GfxTextureDesc texture_desc;
+    texture_desc.width = resolution;
+    texture_desc.height = resolution;
+    texture_desc.format = blast::FORMAT_R32G32_FLOAT;
+    texture_desc.mem_usage = blast::MEMORY_USAGE_GPU_ONLY;
+    texture_desc.res_usage = blast::RESOURCE_USAGE_SHADER_RESOURCE | blast::RESOURCE_USAGE_UNORDERED_ACCESS;
+
+    for (int i = 0; i < frame_count; i++) {
+        Simulate(cmd, 2.0f * PI * i / frame_count);
+
+        blast::GfxTexture* frame = context->device->CreateTexture(texture_desc);
+        DispatchLoopShader(cmd, 0, height_map, height_map, frame, size / resolution, 0.0f);
+        loop_frames.push_back(frame);
+    }
+
+    if (blend_frames) {
+        loop_blend_map = context->device->CreateTexture(texture_desc);
+    }
+    output_map = loop_frames[0];
+    return true;
+}
+
+void WavesGenerator::ClearLoop() {
+    for (blast::GfxTexture* frame : loop_frames) {
+        context->device->DestroyTexture(frame);
+    }
+    loop_frames.clear();
+
+    if (loop_blend_map) {
+        context->device->DestroyTexture(loop_blend_map);
+        loop_blend_map = nullptr;
+    }
+    output_map = height_map;
+}
+
+void WavesGenerator::PlayLoop(blast::GfxCommandBuffer* cmd, float t) {
+    int frame_count = (int)loop_frames.size();
+    float phase = glm::mod(t, (float)(2.0 * PI)) / (float)(2.0 * PI) * frame_count;
+    int frame0 = std::min((int)phase, frame_count - 1);
+    int frame1 = (frame0 + 1) % frame_count;
+
+    if (!loop_blend_map) {
+        output_map = loop_frames[frame0];
+        return;
+    }
+
+    DispatchLoopShader(cmd, 1, loop_frames[frame0], loop_frames[frame1], loop_blend_map, 1, phase - frame0);
+    output_map = loop_blend_map;
+}
+
+void WavesGenerator::DispatchLoopShader(blast::GfxCommandBuffer* cmd, int stage, blast::GfxTexture* source0, blast::GfxTexture* source1,
+                                        blast::GfxTexture* dest, int scale, float alpha) {
+    struct LoopParam {
+        int stage;
+        int scale;
+        float alpha;
+    } loop_param = { stage, scale, alpha };
+
+    blast::GfxDevice* device = context->device;
+
+    blast::GfxTextureBarrier texture_barriers[3];
+    texture_barriers[0].texture = source0;
+    texture_barriers[0].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
+    texture_barriers[1].texture = dest;
+    texture_barriers[1].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
+    texture_barriers[2].texture = source1;
+    texture_barriers[2].new_state = blast::RESOURCE_STATE_UNORDERED_ACCESS;
+    uint32_t barrier_count = source1 != source0 ? 3 : 2;
+    device->SetBarrier(cmd, 0, nullptr, barrier_count, texture_barriers);
+
+    device->BindComputeShader(cmd, context->loop_shader);
 
-    context->device->UpdateTexture(cmd, height_map, height_data);
+    device->BindUAV(cmd, source0, 0);
 
-    barrier.texture = height_map;
-    barrier.new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
-    context->device->SetBarrier(cmd, 0, nullptr, 1, &barrier);
+    device->BindUAV(cmd, source1, 1);
 
-    fft->Execute(cmd, height_map, height_map);
+    device->BindUAV(cmd, dest, 2);
+
+    device->PushConstants(cmd, &loop_param, sizeof(LoopParam));
+
+    device->Dispatch(cmd, std::max(1u, (uint32_t)(dest->desc.width) / 16), std::max(1u, (uint32_t)(dest->desc.height) / 16), 1);
+
+    for (uint32_t i = 0; i < barrier_count; i++) {
+        texture_barriers[i].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
+    }
+    device->SetBarrier(cmd, 0, nullptr, barrier_count, texture_barriers);
+}
+
+void WavesGenerator::EvolveRow(int n, float t, glm::vec2* out, size_t channel_stride) {
+    bool pack = channels_per_map > 1;
+    // Row 0 takes the test bins between the heights and the derived channels
+    int count = n == 0 ? 1 : channel_count;
+    if (phase_table.count > 0) {
+        EvolveSpectrumChannels(spectrum, phase_table, size, (float)length, n, count, out, channel_stride, pack);
+    } else {
+        EvolveSpectrumChannels(spectrum, t, size, (float)length, n, count, out, channel_stride, pack);
+    }
+    if (n == 0) {
+        SetSpectrumTestBins(out, size, !USE_HALF_SPECTRUM);
+        DeriveSpectrumChannels(size, (float)length, n, channel_count, out, channel_stride, pack);
+    }
+}
+
+void WavesGenerator::EvolveFftRow(void* user, unsigned int y, am_fft_complex_t* row) {
+    WavesGenerator* generator = (WavesGenerator*)user;
+    // The batched fft takes the row of map i at row + i * size
+    generator->EvolveRow((int)y, generator->evolve_time, (glm::vec2*)row, generator->size);
+}
+
+void WavesGenerator::Simulate(blast::GfxCommandBuffer* cmd, float t) {
+    bool use_phase_table = phase_table.count > 0;
+    if (use_phase_table) {
+        BuildPhaseTable(t, phase_table);
+    }
+
+#if !USE_GPU_FFT && !USE_HALF_SPECTRUM && USE_FUSED_EVOLUTION
+    // The dense spectrum is evolved row by row inside the fft below
+    bool fused = !sparse_active;
+    evolve_time = t;
+#else
+    bool fused = false;
+#endif
+
+    if (sparse_active) {
+        thread_pool->ParallelFor(sparse.count, block_rows * size, [&](int begin, int end) {
+            if (use_phase_table) {
+                EvolveSparseSpectrum(sparse, phase_table, begin, end, height_data);
+            } else {
+                EvolveSparseSpectrum(sparse, t, begin, end, height_data);
+            }
+        });
+#if USE_HALF_SPECTRUM && USE_GPU_FFT
+        // Pack the surviving edge bins the same way EvolveHalfSpectrum does, pruned ones stay zero in edge_data
+        if (use_phase_table) {
+            EvolveSparseSpectrum(sparse_edges, phase_table, 0, sparse_edges.count, edge_data);
+        } else {
+            EvolveSparseSpectrum(sparse_edges, t, 0, sparse_edges.count, edge_data);
+        }
+        for (int n = 0; n < size; n++) {
+            glm::vec2 dc = edge_data[n * 2];
+            glm::vec2 nyquist = edge_data[n * 2 + 1];
+            height_data[n * (size / 2)] = dc + glm::vec2(-nyquist.y, nyquist.x);
+        }
+#endif
+        SetSpectrumTestBins(height_data, size, !USE_HALF_SPECTRUM);
+        if (channel_count > 1) {
+            thread_pool->ParallelFor(size, block_rows, [&](int begin, int end) {
+                for (int n = begin; n < end; n++) {
+                    DeriveSpectrumChannels(size, (float)length, n, channel_count, height_data + n * size, (size_t)size * size, channels_per_map > 1);
+                }
+            });
+        }
+    } else if (!fused) {
+        thread_pool->ParallelFor(size, block_rows, [&](int begin, int end) {
+#if USE_HALF_SPECTRUM
+            // The gpu transform takes the nyquist column packed into column 0
+            if (use_phase_table) {
+                EvolveHalfSpectrum(spectrum, phase_table, size, begin, end, height_data, USE_GPU_FFT);
+            } else {
+                EvolveHalfSpectrum(spectrum, t, size, begin, end, height_data, USE_GPU_FFT);
+            }
 #else
-    am_fft_2d(fft_plan, (am_fft_complex_t*)height_data, (am_fft_complex_t*)fft_out);
+            for (int n = begin; n < end; n++) {
+                EvolveRow(n, t, height_data + n * size, (size_t)size * size);
+            }
+#endif
+        });
+#if USE_HALF_SPECTRUM
+        SetSpectrumTestBins(height_data, size, !USE_HALF_SPECTRUM);
+#endif
+    }
 
-    blast::GfxTextureBarrier barrier;
-    barrier.texture = height_map;
-    barrier.new_state = blast::RESOURCE_STATE_COPY_DEST;
-    context->device->SetBarrier(cmd, 0, nullptr, 1, &barrier);
+#if USE_GPU_FFT
+    // Every channel is transformed in place in its own map, apart from the half spectrum input
+    blast::GfxTexture* spectrum_textures[SPECTRUM_CHANNEL_COUNT];
+    blast::GfxTextureBarrier barriers[SPECTRUM_CHANNEL_COUNT];
+    for (int c = 0; c < map_count; c++) {
+        spectrum_textures[c] = c == 0 && spectrum_map ? spectrum_map : channel_maps[c];
+        barriers[c].texture = spectrum_textures[c];
+        barriers[c].new_state = blast::RESOURCE_STATE_COPY_DEST;
+    }
+    context->device->SetBarrier(cmd, 0, nullptr, map_count, barriers);
 
-    context->device->UpdateTexture(cmd, height_map, fft_out);
+    for (int c = 0; c < map_count; c++) {
+        context->device->UpdateTexture(cmd, spectrum_textures[c], height_data + c * size * size);
+        barriers[c].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
+    }
+    context->device->SetBarrier(cmd, 0, nullptr, map_count, barriers);
 
-    barrier.texture = height_map;
-    barrier.new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
-    context->device->SetBarrier(cmd, 0, nullptr, 1, &barrier);
+    fft->Execute(cmd, spectrum_textures, channel_maps, map_count);
+#else
+#if USE_HALF_SPECTRUM
+    // The real heights fill the front half of fft_out, widen them in place from the back into (height, 0) texels
+    float* heights = (float*)fft_out;
+    am_fft_2d_c2r_parallel(fft_plan, (am_fft_complex_t*)height_data, heights, ParallelFft, thread_pool);
+    for (int i = size * size - 1; i >= 0; i--) {
+        fft_out[i] = glm::vec2(heights[i], 0.0f);
+    }
+#else
+    if (fused) {
+        am_fft_2d_batch_load_scratch(fft_plan, map_count, EvolveFftRow, this, (am_fft_complex_t*)fft_out, (am_fft_complex_t*)fft_scratch,
+                                     ParallelFft, thread_pool);
+    } else {
+        am_fft_2d_batch_scratch(fft_plan, map_count, (am_fft_complex_t*)height_data, (am_fft_complex_t*)fft_out, (am_fft_complex_t*)fft_scratch,
+                                ParallelFft, thread_pool);
+    }
+#endif
+
+    // Real heights for SampleHeights, with the (-1)^(row + column) of the uncentred transform taken out
+    thread_pool->ParallelFor(size, block_rows, [&](int begin, int end) {
+        for (int a = begin; a < end; a++) {
+            for (int b = 0; b < size; b++) {
+                float height = fft_out[a * size + b].x;
+                sample_heights[a * size + b] = (a + b) & 1 ? -height : height;
+            }
+        }
+    });
+
+    blast::GfxTextureBarrier barriers[SPECTRUM_CHANNEL_COUNT];
+    for (int c = 0; c < map_count; c++) {
+        barriers[c].texture = channel_maps[c];
+        barriers[c].new_state = blast::RESOURCE_STATE_COPY_DEST;
+    }
+    context->device->SetBarrier(cmd, 0, nullptr, map_count, barriers);
+
+    for (int c = 0; c < map_count; c++) {
+        context->device->UpdateTexture(cmd, channel_maps[c], fft_out + c * size * size);
+        barriers[c].new_state = blast::RESOURCE_STATE_SHADER_RESOURCE;
+    }
+    context->device->SetBarrier(cmd, 0, nullptr, map_count, barriers);
 #endif
 }
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include "OceanDefine.h"
 #include "FourierTransform.h"
+#include "SpectrumCache.h"
+#include "SpectrumKernel.h"
+#include "ThreadPool.h"
 
 #include <Blast/Gfx/GfxDefine.h>
 #include <Blast/Gfx/GfxDevice.h>
@@ -9,40 +12,140 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct SpectrumPruneStats {
+    int total_bins = 0;
+    int kept_bins = 0;
+    // Fraction of the spectrum energy, |h0(k)|^2 + |h0(-k)|^2 summed over bins, held by the kept bins
+    float retained_energy = 1.0f;
+};
+
 class WavesGenerator {
 public:
-    WavesGenerator(Context* context, int size, int length);
+    // thread_pool is borrowed when given, otherwise the generator owns a pool with one thread per core.
+    // The same seed gives the same ocean on every machine and thread count.
+    // With a cache_directory the spectrum tables are stored there once and memory mapped on later starts,
+    // next to the am_fft wisdom of the cpu fft.
+    WavesGenerator(Context* context, int size, int length, ThreadPool* thread_pool = nullptr, uint32_t seed = 0,
+                   const std::string& cache_directory = "");
 
     ~WavesGenerator();
 
     void Update(blast::GfxCommandBuffer* cmd, float t);
 
-    blast::GfxTexture* GetHeightMap() { return height_map; }
+    // Renders one full period (2 * PI, exact because omega is whole) into a ring of frame_count height maps of
+    // resolution x resolution. Afterwards Update only picks the ring frame for t, or blends the two nearest with blend_frames.
+    // Returns false when omega is not quantized or resolution does not divide size.
+    bool BakeLoop(blast::GfxCommandBuffer* cmd, int frame_count, int resolution, bool blend_frames);
+
+    // Drops the baked ring and goes back to simulating every frame.
+    void ClearLoop();
+
+    // Keeps only the most energetic bins that together hold energy_fraction of the spectrum energy and evolves just those,
+    // scattered into an otherwise zero fft input. energy_fraction >= 1 goes back to evolving every bin.
+    void PruneSpectrum(float energy_fraction);
+
+    const SpectrumPruneStats& GetPruneStats() const { return prune_stats; }
+
+    // Heights at world positions (x, z) and any time t, summed straight from the harmonic_count most energetic harmonics
+    // (at most 65536) with no fft or gpu readback. On texel centres it matches the real part of the height map times the
+    // (-1)^(row + column) sign of the uncentred transform, up to the dropped harmonics.
+    // Costs O(harmonic_count * count) on the calling thread and may run while Update is in flight.
+    void EvaluateHeights(const glm::vec2* positions, int count, float t, int harmonic_count, float* heights);
+
+    // Filters the height field of the last simulated frame at world positions (x, z), wrapped over length, and writes
+    // (dh/dx, dh/dz) to gradients when given. Spread over the thread pool, so call it between updates.
+    // Needs the cpu fft and returns false with the gpu one.
+    bool SampleHeights(const glm::vec2* positions, int count, HeightFilter filter, float* heights, glm::vec2* gradients = nullptr);
+
+    blast::GfxTexture* GetHeightMap() { return output_map; }
+
+    // Map holding a transformed field of the last simulated frame with the same layout and sign as the height map, or nullptr when
+    // the channel is not produced (see USE_DERIVED_CHANNELS). Displacements are unscaled, multiply them by the choppiness.
+    // With USE_PACKED_CHANNELS two fields share a map, GetChannelComponent says whether the field is in red (0) or green (1).
+    blast::GfxTexture* GetChannelMap(SpectrumChannel channel) { return channel < channel_count ? channel_maps[channel / channels_per_map] : nullptr; }
+
+    int GetChannelComponent(SpectrumChannel channel) const { return channel % channels_per_map; }
 
 private:
-    glm::vec2 RandomVariable();
+    void Simulate(blast::GfxCommandBuffer* cmd, float t);
+
+    void PlayLoop(blast::GfxCommandBuffer* cmd, float t);
+
+    void ClearSparse();
+
+    void BuildHarmonics();
+
+    // h0(k) and conj(h0(-k)) of bin (n, m), the half spectrum mode reads the latter from the mirrored bin.
+    void GetBin(int n, int m, glm::vec2* h0, glm::vec2* h0_conj);
+
+    // am_fft scheduler that runs each pass of the cpu fft on the thread pool, scheduler is the pool.
+    static void ParallelFft(void* scheduler, am_fft_task_t task, void* data, unsigned int count);
+
+    // Evolves spectrum row n of the full plane to t and derives the other channels, channel or map i at out + i * channel_stride.
+    void EvolveRow(int n, float t, glm::vec2* out, size_t channel_stride);
+
+    // am_fft row loader of the fused cpu path, evolves spectrum row y to evolve_time into the rows of all channels. user is the generator.
+    static void EvolveFftRow(void* user, unsigned int y, am_fft_complex_t* row);
+
+    void DispatchLoopShader(blast::GfxCommandBuffer* cmd, int stage, blast::GfxTexture* source0, blast::GfxTexture* source1,
+                            blast::GfxTexture* dest, int scale, float alpha);
+
+
+    // Fills h0, h0_conj and omega of the spectrum, split over the thread pool.
+    void InitTables();
 
     float Dispersion(int n, int m);
 
     float PhillipsSpectrum(int n, int m);
 
-    glm::vec2 InitSpectrum(int n, int m);
-
-    glm::vec2 UpdateSpectrum(float t, int n, int m);
+    // Pure function of (seed, n, m, stream), any single bin can be regenerated on its own.
+    // stream 0 draws h0(k), stream 1 the independent h0(-k) of the full plane mode.
+    glm::vec2 InitSpectrum(int n, int m, int stream);
 
 private:
     int size = 0;
     int length = 0;
+    uint32_t seed = 0;
     float wave_amp = 0.0f;
-    float* dispersion_table = nullptr;
     glm::vec2 wind_speed = glm::vec2(0.0f);
-    glm::vec2* spectrum = nullptr;
-    glm::vec2* spectrum_conj = nullptr;
+    float* spectrum_storage = nullptr;
+    SpectrumCache spectrum_cache;
+    SpectrumData spectrum;
+    float* phase_storage = nullptr;
+    PhaseTable phase_table;
+    bool sparse_active = false;
+    SparseSpectrum sparse;
+    SparseSpectrum sparse_edges;
+    float* sparse_storage = nullptr;
+    int* sparse_index_storage = nullptr;
+    glm::vec2* edge_data = nullptr;
+    SpectrumPruneStats prune_stats;
+    HarmonicList harmonics;
+    float* harmonic_storage = nullptr;
+    std::once_flag harmonics_once;
     glm::vec2* height_data = nullptr;
     blast::GfxTexture* height_map = nullptr;
+    int channel_count = 1;
+    int channels_per_map = 1;
+    int map_count = 1;
+    blast::GfxTexture* channel_maps[SPECTRUM_CHANNEL_COUNT] = {};
+    blast::GfxTexture* spectrum_map = nullptr;
+    blast::GfxTexture* output_map = nullptr;
+    std::vector<blast::GfxTexture*> loop_frames;
+    blast::GfxTexture* loop_blend_map = nullptr;
     Context* context = nullptr;
     FourierTransform* fft = nullptr;
+    ThreadPool* thread_pool = nullptr;
+    bool owns_thread_pool = false;
+    int block_rows = 1;
 
     glm::vec2* fft_out = nullptr;
+    glm::vec2* fft_scratch = nullptr;
+    float* sample_heights = nullptr;
     am_fft_plan_2d_t* fft_plan = nullptr;
+    float evolve_time = 0.0f;
 };
\ No newline at end of file
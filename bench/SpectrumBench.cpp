@@ -0,0 +1,83 @@
+#include "SpectrumKernel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Per-texel throughput of the spectrum evolution kernels at every instruction set the cpu has.
+// Usage: SpectrumBench [size], size defaults to 512 for a size x size spectrum.
+
+#define BENCH_RUNS 9
+
+static const char* level_names[] = { "scalar", "sse2", "avx2" };
+
+// Best of BENCH_RUNS, each run evolving the whole spectrum frames times
+template<typename Evolve>
+static double NanosecondsPerTexel(int bin_count, int frames, Evolve evolve) {
+    double best = -1.0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            evolve(frame * (1.0f / 60.0f));
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = best < 0.0 ? seconds : std::min(best, seconds);
+    }
+    return best * 1e9 / ((double)bin_count * frames);
+}
+
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 512;
+    if (size <= 0) {
+        printf("usage: SpectrumBench [size]\n");
+        return 1;
+    }
+    int bin_count = size * size;
+    int frames = std::max(1, (1 << 22) / bin_count);
+
+    // Random amplitudes and whole dispersion values, so the table driven path runs too
+    std::vector<float> tables((size_t)bin_count * 5);
+    SpectrumData data;
+    data.h0_re = tables.data();
+    data.h0_im = data.h0_re + bin_count;
+    data.h0_conj_re = data.h0_im + bin_count;
+    data.h0_conj_im = data.h0_conj_re + bin_count;
+    data.omega = data.h0_conj_im + bin_count;
+    uint32_t state = 12345u;
+    for (int i = 0; i < bin_count * 4; i++) {
+        state = state * 1664525u + 1013904223u;
+        tables[i] = (float)(state >> 8) / (float)(1u << 24) - 0.5f;
+    }
+    int max_omega = 0;
+    for (int n = 0; n < size; n++) {
+        for (int m = 0; m < size; m++) {
+            float kx = 2.0f * n - size;
+            float kz = 2.0f * m - size;
+            int omega = (int)glm::sqrt(9.81f * glm::sqrt(kx * kx + kz * kz));
+            data.omega[n * size + m] = (float)omega;
+            max_omega = std::max(max_omega, omega);
+        }
+    }
+    std::vector<float> phase_storage((max_omega + 1) * 2);
+    PhaseTable table;
+    table.cos_table = phase_storage.data();
+    table.sin_table = table.cos_table + max_omega + 1;
+    table.count = max_omega + 1;
+
+    std::vector<glm::vec2> out(bin_count);
+    printf("%d x %d spectrum, ns per texel\n", size, size);
+    printf("%-8s %10s %10s\n", "level", "direct", "table");
+    for (int level = SIMD_LEVEL_SCALAR; level <= GetSimdLevel(); level++) {
+        double direct = NanosecondsPerTexel(bin_count, frames, [&](float t) {
+            EvolveSpectrum(data, t, 0, bin_count, out.data(), (SimdLevel)level);
+        });
+        double tabled = NanosecondsPerTexel(bin_count, frames, [&](float t) {
+            BuildPhaseTable(t, table);
+            EvolveSpectrum(data, table, 0, bin_count, out.data(), (SimdLevel)level);
+        });
+        printf("%-8s %10.2f %10.2f\n", level_names[level], direct, tabled);
+    }
+    return 0;
+}
@@ -69,6 +69,8 @@ blast::GfxPipeline* blit_pipeline = nullptr;
 blast::GfxShader* copy_shader = nullptr;
 blast::GfxShader* luminance_shader = nullptr;
 blast::GfxShader* fft_shader = nullptr;
+blast::GfxShader* c2r_shader = nullptr;
+blast::GfxShader* loop_shader = nullptr;
 
 blast::GfxBuffer* g_quad_index_buffer = nullptr;
 blast::GfxBuffer* g_quad_vertex_buffer = nullptr;
@@ -138,6 +140,12 @@ int main() {
     {
         fft_shader = CompileComputeShader(ProjectDir + "/Resources/Shaders/fft.comp");
     }
+    {
+        c2r_shader = CompileComputeShader(ProjectDir + "/Resources/Shaders/c2r.comp");
+    }
+    {
+        loop_shader = CompileComputeShader(ProjectDir + "/Resources/Shaders/loop.comp");
+    }
     {
         luminance_shader = CompileComputeShader(ProjectDir + "/Resources/Shaders/luminance.comp");
     }
@@ -148,6 +156,8 @@ int main() {
     g_context->device = g_device;
     g_context->fft_shader = fft_shader;
     g_context->copy_shader = copy_shader;
+    g_context->c2r_shader = c2r_shader;
+    g_context->loop_shader = loop_shader;
 
     // load quad buffers
     {
@@ -225,7 +235,7 @@ int main() {
         object_ub = g_device->CreateBuffer(buffer_desc);
     }
 
-    waves_generator = new WavesGenerator(g_context, 512, 512);
+    waves_generator = new WavesGenerator(g_context, 512, 512, nullptr, 0, ProjectDir + "/Cache");
 
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -413,6 +423,8 @@ int main() {
     g_device->DestroyShader(scene_frag_shader);
     g_device->DestroyShader(copy_shader);
     g_device->DestroyShader(fft_shader);
+    g_device->DestroyShader(c2r_shader);
+    g_device->DestroyShader(loop_shader);
     g_device->DestroyShader(luminance_shader);
 
     if (scene_renderpass) {
@@ -0,0 +1,477 @@
+#include <am_fft.h>
+
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// Checks every kind of am_fft plan against a naive dft in double precision: 1D complex and real dfts on every engine and
+// instruction set (forced through wisdom files), column strips, 2D complex dfts in and out of place on square and rectangular
+// grids with columns in strips or between transposes, threaded and row loaded dfts, batches, real 2D dfts and the out-of-core
+// file dfts.
+
+typedef std::complex<double> Complex;
+
+// std::vector cannot hold arrays, so the floats stay flat and are viewed as am_fft_complex_t
+struct ComplexBuffer {
+    std::vector<float> values;
+
+    explicit ComplexBuffer(size_t count = 0) : values(2 * count) {}
+    am_fft_complex_t* data() { return (am_fft_complex_t*)values.data(); }
+    const am_fft_complex_t* data() const { return (const am_fft_complex_t*)values.data(); }
+    size_t size() const { return values.size() / 2; }
+    am_fft_complex_t& operator[](size_t i) { return data()[i]; }
+};
+
+static const char* wisdom_path = "AmFftTest.wisdom";
+
+static int failures = 0;
+
+static uint32_t random_state = 12345u;
+
+static float Random() {
+    random_state = random_state * 1664525u + 1013904223u;
+    return (float)(random_state >> 8) / (float)(1u << 24) - 0.5f;
+}
+
+static std::vector<Complex> RandomComplex(size_t count) {
+    std::vector<Complex> values(count);
+    for (Complex& value : values) {
+        float re = Random();
+        value = Complex(re, Random());
+    }
+    return values;
+}
+
+static std::vector<float> RandomReal(size_t count) {
+    std::vector<float> values(count);
+    for (float& value : values) {
+        value = Random();
+    }
+    return values;
+}
+
+static ComplexBuffer ToFloat(const std::vector<Complex>& values) {
+    ComplexBuffer result(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        result[i][0] = (float)values[i].real();
+        result[i][1] = (float)values[i].imag();
+    }
+    return result;
+}
+
+// Naive dft of count sequences of n values, element j of sequence c at in[c * distance + j * stride]
+static void NaiveDft(int direction, unsigned int n, unsigned int count, size_t stride, size_t distance, std::vector<Complex>& values) {
+    double sign = direction == AM_FFT_FORWARD ? -1.0 : 1.0;
+    std::vector<Complex> twiddles(n), sequence(n);
+    for (unsigned int k = 0; k < n; k++) {
+        double angle = sign * 2.0 * 3.14159265358979323846 * k / n;
+        twiddles[k] = Complex(std::cos(angle), std::sin(angle));
+    }
+    for (unsigned int c = 0; c < count; c++) {
+        for (unsigned int j = 0; j < n; j++) {
+            sequence[j] = values[c * distance + j * stride];
+        }
+        for (unsigned int k = 0; k < n; k++) {
+            Complex sum = 0.0;
+            for (unsigned int j = 0; j < n; j++) {
+                sum += sequence[j] * twiddles[(size_t)j * k % n];
+            }
+            values[c * distance + k * stride] = sum;
+        }
+    }
+}
+
+static std::vector<Complex> NaiveDft1d(int direction, const std::vector<Complex>& in) {
+    std::vector<Complex> out = in;
+    NaiveDft(direction, (unsigned int)in.size(), 1, 1, 0, out);
+    return out;
+}
+
+// Rows of width values first, then the columns
+static std::vector<Complex> NaiveDft2d(int direction, unsigned int width, unsigned int height, const std::vector<Complex>& in) {
+    std::vector<Complex> out = in;
+    NaiveDft(direction, width, height, 1, width, out);
+    NaiveDft(direction, height, width, width, 1, out);
+    return out;
+}
+
+// Largest error relative to the largest reference value
+static double RelativeError(const am_fft_complex_t* result, const Complex* reference, size_t count) {
+    double error = 0.0, scale = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        error = std::max(error, std::abs(Complex(result[i][0], result[i][1]) - reference[i]));
+        scale = std::max(scale, std::abs(reference[i]));
+    }
+    return error / std::max(scale, 1e-30);
+}
+
+static double RelativeError(const float* result, const std::vector<double>& reference) {
+    double error = 0.0, scale = 0.0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        error = std::max(error, std::abs(result[i] - reference[i]));
+        scale = std::max(scale, std::abs(reference[i]));
+    }
+    return error / std::max(scale, 1e-30);
+}
+
+static void Check(double error, const char* what, unsigned int width, unsigned int height, int direction) {
+    if (!(error < 1e-4)) {
+        printf("%s %ux%u %s: relative error %g\n", what, width, height, direction == AM_FFT_FORWARD ? "forward" : "inverse", error);
+        failures++;
+    }
+}
+
+static void CheckPlan(const void* plan, const char* what, unsigned int width, unsigned int height) {
+    if (!plan) {
+        printf("%s %ux%u: no plan\n", what, width, height);
+        failures++;
+    }
+}
+
+// Replaces the wisdom of the 1D size width (dimensions 1, height 1) or of the 2D grid width x height
+static void ForceWisdom(int dimensions, unsigned int width, unsigned int height, int engine, int simd) {
+    FILE* file = fopen(wisdom_path, "w");
+    fprintf(file, "am_fft_wisdom 2\n%d %u %u %d %d\n", dimensions, width, height, engine, simd);
+    fclose(file);
+    if (!am_fft_wisdom_load(wisdom_path)) {
+        printf("could not load the wisdom for %ux%u\n", width, height);
+        failures++;
+    }
+}
+
+static void SerialFor(void* scheduler, am_fft_task_t task, void* data, unsigned int count) {
+    (void)scheduler;
+    for (unsigned int i = count; i-- > 0;) {
+        task(data, i);
+    }
+}
+
+static void Test1d(unsigned int n, int direction, const char* what) {
+    am_fft_plan_1d_t* plan = am_fft_plan_1d(direction, n);
+    CheckPlan(plan, what, n, 1);
+    if (!plan) {
+        return;
+    }
+    std::vector<Complex> in = RandomComplex(n);
+    std::vector<Complex> reference = NaiveDft1d(direction, in);
+    ComplexBuffer in_f = ToFloat(in), out(n), scratch(n);
+    am_fft_1d(plan, in_f.data(), out.data());
+    Check(RelativeError(out.data(), reference.data(), n), what, n, 1, direction);
+    am_fft_plan_1d_free(plan);
+
+    plan = am_fft_plan_1d(direction | AM_FFT_NO_SCRATCH, n);
+    am_fft_1d_scratch(plan, in_f.data(), out.data(), scratch.data());
+    Check(RelativeError(out.data(), reference.data(), n), "1d scratch", n, 1, direction);
+    am_fft_plan_1d_free(plan);
+}
+
+static void TestColumns(unsigned int n, unsigned int count, unsigned int stride, int direction) {
+    am_fft_plan_1d_t* plan = am_fft_plan_1d(direction, n);
+    CheckPlan(plan, "columns", n, count);
+    if (!plan) {
+        return;
+    }
+    std::vector<Complex> in = RandomComplex((size_t)n * stride);
+    std::vector<Complex> reference = in;
+    NaiveDft(direction, n, count, stride, 1, reference);
+    ComplexBuffer in_f = ToFloat(in), out = ToFloat(in), scratch(2 * n * AM_FFT_COLUMN_BATCH);
+    am_fft_1d_columns(plan, in_f.data(), out.data(), stride, count, scratch.data());
+    // The columns past count must stay untouched
+    for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int c = count; c < stride; c++) {
+            reference[i * stride + c] = in[i * stride + c];
+        }
+    }
+    Check(RelativeError(out.data(), reference.data(), reference.size()), "columns", n, count, direction);
+    am_fft_plan_1d_free(plan);
+}
+
+static void TestReal1d(unsigned int n, int direction) {
+    std::vector<float> in = RandomReal(n);
+    std::vector<Complex> in_c(in.begin(), in.end());
+    std::vector<Complex> spectrum = NaiveDft1d(direction, in_c);
+
+    am_fft_plan_1d_t* plan = am_fft_plan_1d_r2c(direction, n);
+    CheckPlan(plan, "r2c", n, 1);
+    if (plan) {
+        ComplexBuffer out(n / 2 + 1);
+        am_fft_1d_r2c(plan, in.data(), out.data());
+        Check(RelativeError(out.data(), spectrum.data(), n / 2 + 1), "r2c", n, 1, direction);
+        am_fft_plan_1d_free(plan);
+    }
+
+    // c2r of the spectrum of in from the other direction gives n * in
+    int other = direction == AM_FFT_FORWARD ? AM_FFT_INVERSE : AM_FFT_FORWARD;
+    std::vector<Complex> other_spectrum = NaiveDft1d(other, in_c);
+    plan = am_fft_plan_1d_c2r(direction, n);
+    CheckPlan(plan, "c2r", n, 1);
+    if (plan) {
+        ComplexBuffer half = ToFloat(std::vector<Complex>(other_spectrum.begin(), other_spectrum.begin() + n / 2 + 1));
+        std::vector<float> out(n);
+        std::vector<double> expected(n);
+        for (unsigned int i = 0; i < n; i++) {
+            expected[i] = (double)n * in[i];
+        }
+        am_fft_1d_c2r(plan, half.data(), out.data());
+        Check(RelativeError(out.data(), expected), "c2r", n, 1, direction);
+        am_fft_plan_1d_free(plan);
+    }
+}
+
+struct LoadGrid {
+    const am_fft_complex_t* values;
+    unsigned int width;
+    unsigned int height;
+    unsigned int count;
+};
+
+// Row y of every grid, grid c at row + c * width
+static void LoadRows(void* user, unsigned int y, am_fft_complex_t* row) {
+    const LoadGrid* grid = (const LoadGrid*)user;
+    for (unsigned int c = 0; c < grid->count; c++) {
+        memcpy(row + c * grid->width, grid->values + ((size_t)c * grid->height + y) * grid->width, grid->width * sizeof(am_fft_complex_t));
+    }
+}
+
+static void Test2d(unsigned int width, unsigned int height, int direction) {
+    size_t cells = (size_t)width * height;
+    std::vector<Complex> in = RandomComplex(cells);
+    std::vector<Complex> reference = NaiveDft2d(direction, width, height, in);
+    ComplexBuffer in_f = ToFloat(in);
+
+    // Column strips and transposes, whichever the size picks by default is forced both ways
+    for (int columns = 1; columns >= 0; columns--) {
+        ForceWisdom(2, width, height, columns, 0);
+        am_fft_plan_2d_t* plan = am_fft_plan_2d(direction, width, height);
+        CheckPlan(plan, "2d", width, height);
+        if (!plan) {
+            continue;
+        }
+        const char* what = columns ? "2d columns" : "2d transposed";
+        ComplexBuffer out(cells);
+        am_fft_2d(plan, in_f.data(), out.data());
+        Check(RelativeError(out.data(), reference.data(), cells), what, width, height, direction);
+
+        ComplexBuffer in_place = in_f;
+        am_fft_2d(plan, in_place.data(), in_place.data());
+        Check(RelativeError(in_place.data(), reference.data(), cells), "2d in place", width, height, direction);
+
+        am_fft_2d_parallel(plan, in_f.data(), out.data(), SerialFor, 0);
+        Check(RelativeError(out.data(), reference.data(), cells), "2d parallel", width, height, direction);
+
+        am_fft_2d_threaded(plan, in_f.data(), out.data(), 4);
+        Check(RelativeError(out.data(), reference.data(), cells), "2d threaded", width, height, direction);
+
+        LoadGrid grid = { in_f.data(), width, height, 1 };
+        am_fft_2d_load(plan, LoadRows, &grid, out.data());
+        Check(RelativeError(out.data(), reference.data(), cells), "2d load", width, height, direction);
+
+        am_fft_2d_load_parallel(plan, LoadRows, &grid, out.data(), SerialFor, 0);
+        Check(RelativeError(out.data(), reference.data(), cells), "2d load parallel", width, height, direction);
+        am_fft_plan_2d_free(plan);
+
+        plan = am_fft_plan_2d(direction | AM_FFT_NO_SCRATCH, width, height);
+        ComplexBuffer scratch(am_fft_2d_scratch_size(plan));
+        am_fft_2d_scratch(plan, in_f.data(), out.data(), scratch.data(), SerialFor, 0);
+        Check(RelativeError(out.data(), reference.data(), cells), "2d scratch", width, height, direction);
+
+        // Batch of three grids, the second one the same as the single grid above
+        const unsigned int count = 3;
+        std::vector<Complex> batch_in = RandomComplex(cells * count);
+        std::copy(in.begin(), in.end(), batch_in.begin() + cells);
+        std::vector<Complex> batch_reference(cells * count);
+        for (unsigned int c = 0; c < count; c++) {
+            std::vector<Complex> grid_reference = NaiveDft2d(direction, width, height, std::vector<Complex>(batch_in.begin() + c * cells, batch_in.begin() + (c + 1) * cells));
+            std::copy(grid_reference.begin(), grid_reference.end(), batch_reference.begin() + c * cells);
+        }
+        ComplexBuffer batch_in_f = ToFloat(batch_in), batch_out(cells * count);
+        ComplexBuffer batch_scratch(am_fft_2d_batch_scratch_size(plan, count));
+        am_fft_2d_batch_scratch(plan, count, batch_in_f.data(), batch_out.data(), batch_scratch.data(), SerialFor, 0);
+        Check(RelativeError(batch_out.data(), batch_reference.data(), cells * count), "2d batch", width, height, direction);
+
+        LoadGrid batch_grid = { batch_in_f.data(), width, height, count };
+        am_fft_2d_batch_load_scratch(plan, count, LoadRows, &batch_grid, batch_out.data(), batch_scratch.data(), 0, 0);
+        Check(RelativeError(batch_out.data(), batch_reference.data(), cells * count), "2d batch load", width, height, direction);
+        am_fft_plan_2d_free(plan);
+    }
+}
+
+static void TestReal2d(unsigned int width, unsigned int height, int direction) {
+    size_t cells = (size_t)width * height;
+    unsigned int columns = width / 2 + 1;
+    std::vector<float> in = RandomReal(cells);
+    std::vector<Complex> in_c(in.begin(), in.end());
+
+    std::vector<Complex> spectrum = NaiveDft2d(direction, width, height, in_c), half(columns * height);
+    for (unsigned int y = 0; y < height; y++) {
+        std::copy(spectrum.begin() + y * width, spectrum.begin() + y * width + columns, half.begin() + y * columns);
+    }
+    am_fft_plan_2d_t* plan = am_fft_plan_2d_r2c(direction, width, height);
+    CheckPlan(plan, "2d r2c", width, height);
+    if (plan) {
+        ComplexBuffer out(columns * height);
+        am_fft_2d_r2c(plan, in.data(), out.data());
+        Check(RelativeError(out.data(), half.data(), half.size()), "2d r2c", width, height, direction);
+        am_fft_2d_r2c_parallel(plan, in.data(), out.data(), SerialFor, 0);
+        Check(RelativeError(out.data(), half.data(), half.size()), "2d r2c parallel", width, height, direction);
+        am_fft_plan_2d_free(plan);
+    }
+
+    int other = direction == AM_FFT_FORWARD ? AM_FFT_INVERSE : AM_FFT_FORWARD;
+    spectrum = NaiveDft2d(other, width, height, in_c);
+    for (unsigned int y = 0; y < height; y++) {
+        std::copy(spectrum.begin() + y * width, spectrum.begin() + y * width + columns, half.begin() + y * columns);
+    }
+    std::vector<double> expected(cells);
+    for (size_t i = 0; i < cells; i++) {
+        expected[i] = (double)cells * in[i];
+    }
+    plan = am_fft_plan_2d_c2r(direction, width, height);
+    CheckPlan(plan, "2d c2r", width, height);
+    if (plan) {
+        ComplexBuffer half_f = ToFloat(half);
+        std::vector<float> out(cells);
+        am_fft_2d_c2r(plan, half_f.data(), out.data());
+        Check(RelativeError(out.data(), expected), "2d c2r", width, height, direction);
+        am_fft_2d_c2r_parallel(plan, half_f.data(), out.data(), SerialFor, 0);
+        Check(RelativeError(out.data(), expected), "2d c2r parallel", width, height, direction);
+        am_fft_plan_2d_free(plan);
+    }
+}
+
+static bool WriteFile(const char* path, const ComplexBuffer& values) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(values.data(), sizeof(am_fft_complex_t), values.size(), file) == values.size();
+    return fclose(file) == 0 && ok;
+}
+
+static bool ReadFile(const char* path, ComplexBuffer& values) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fread(values.data(), sizeof(am_fft_complex_t), values.size(), file) == values.size();
+    fclose(file);
+    return ok;
+}
+
+// A memory budget of a few rows splits the grid into many slabs, in_path == out_path runs it in place
+static void TestFile(unsigned int width, unsigned int height, int direction, size_t memory_budget, bool in_place) {
+    const char* in_path = "AmFftTest.in";
+    const char* out_path = in_place ? in_path : "AmFftTest.out";
+    const char* scratch_path = "AmFftTest.scratch";
+    size_t cells = (size_t)width * height;
+    std::vector<Complex> in = RandomComplex(cells);
+    std::vector<Complex> reference = NaiveDft2d(direction, width, height, in);
+    ComplexBuffer out(cells);
+
+    am_fft_plan_2d_t* plan = am_fft_plan_2d(direction | AM_FFT_NO_SCRATCH, width, height);
+    CheckPlan(plan, "2d file", width, height);
+    if (!plan) {
+        return;
+    }
+    bool ok = WriteFile(in_path, ToFloat(in)) && am_fft_2d_file(plan, in_path, out_path, scratch_path, memory_budget, SerialFor, 0) && ReadFile(out_path, out);
+    if (!ok) {
+        printf("2d file %ux%u: failed\n", width, height);
+        failures++;
+    } else {
+        Check(RelativeError(out.data(), reference.data(), cells), in_place ? "2d file in place" : "2d file", width, height, direction);
+    }
+    am_fft_plan_2d_free(plan);
+    remove(in_path);
+    remove(out_path);
+}
+
+// A width x 1 grid and the 1D size width keep separate wisdom, and both survive a save and load
+static void TestWisdom() {
+    unsigned int n = 64;
+    am_fft_plan_1d_t* plan_1d = am_fft_plan_1d(AM_FFT_FORWARD | AM_FFT_MEASURE, n);
+    am_fft_plan_2d_t* plan_2d = am_fft_plan_2d(AM_FFT_FORWARD | AM_FFT_MEASURE, n, 1);
+    am_fft_plan_1d_free(plan_1d);
+    am_fft_plan_2d_free(plan_2d);
+    if (!am_fft_wisdom_save(wisdom_path) || !am_fft_wisdom_load(wisdom_path)) {
+        printf("wisdom: could not save and load\n");
+        failures++;
+        return;
+    }
+    FILE* file = fopen(wisdom_path, "r");
+    char line[256];
+    int entries_1d = 0, entries_2d = 0;
+    while (file && fgets(line, sizeof(line), file)) {
+        unsigned int width = 0, height = 0;
+        int dimensions = 0, engine = 0, simd = 0;
+        if (sscanf(line, "%d %u %u %d %d", &dimensions, &width, &height, &engine, &simd) == 5 && width == n && height == 1) {
+            entries_1d += dimensions == 1;
+            entries_2d += dimensions == 2 && (engine == 0 || engine == 1);
+        }
+    }
+    if (file) {
+        fclose(file);
+    }
+    if (entries_1d != 1 || entries_2d != 1) {
+        printf("wisdom: %d 1d and %d 2d entries for %u, expected one each\n", entries_1d, entries_2d, n);
+        failures++;
+    }
+    Test1d(n, AM_FFT_FORWARD, "1d after wisdom");
+    Test2d(n, 1, AM_FFT_FORWARD);
+}
+
+int main() {
+    const unsigned int sizes[] = { 2, 3, 4, 5, 6, 8, 12, 15, 16, 60, 64, 128, 256, 384, 512, 960, 1024 };
+    const int directions[] = { AM_FFT_FORWARD, AM_FFT_INVERSE };
+
+    for (int direction : directions) {
+        for (unsigned int n : sizes) {
+            Test1d(n, direction, "1d");
+        }
+
+        // Every engine on every instruction set, the ones the cpu lacks fall back to the widest it has
+        const int engines[] = { 0, 1, 3 };
+        for (int engine : engines) {
+            for (int simd = 0; simd <= 2; simd++) {
+                for (unsigned int n : sizes) {
+                    if (engine == 0 && (n & (n - 1)) != 0) {
+                        continue;
+                    }
+                    ForceWisdom(1, n, 1, engine, simd);
+                    Test1d(n, direction, engine == 0 ? "1d radix2" : engine == 1 ? "1d stockham" : "1d four step");
+                }
+            }
+        }
+
+        TestColumns(12, 5, 7, direction);
+        TestColumns(60, 37, 40, direction);
+        TestColumns(64, 16, 16, direction);
+        TestColumns(384, 3, 3, direction);
+
+        const unsigned int real_sizes[] = { 2, 6, 12, 16, 60, 64, 384, 960 };
+        for (unsigned int n : real_sizes) {
+            TestReal1d(n, direction);
+        }
+
+        const unsigned int grids[][2] = { { 16, 16 }, { 12, 60 }, { 60, 12 }, { 64, 6 }, { 6, 384 }, { 384, 8 }, { 960, 2 }, { 16, 1 }, { 1, 16 }, { 64, 64 } };
+        for (const unsigned int* grid : grids) {
+            Test2d(grid[0], grid[1], direction);
+        }
+
+        const unsigned int real_grids[][2] = { { 16, 16 }, { 12, 6 }, { 6, 12 }, { 64, 60 }, { 384, 4 } };
+        for (const unsigned int* grid : real_grids) {
+            TestReal2d(grid[0], grid[1], direction);
+        }
+
+        TestFile(60, 48, direction, 4096, false);
+        TestFile(64, 12, direction, 4096, true);
+        TestFile(384, 16, direction, 1 << 20, false);
+    }
+
+    TestWisdom();
+    remove(wisdom_path);
+
+    printf(failures ? "AmFftTest failed\n" : "AmFftTest passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+#include "SpectrumKernel.h"
+
+#include <am_fft.h>
+
+#include <cstdio>
+#include <vector>
+
+// Evolves a random hermitian spectrum with the test bins of row 0 applied, as WavesGenerator does, once with every channel
+// in its own map and once packed two to a map, and checks that the transforms of both agree channel by channel.
+static const int size = 16;
+static const float length = 64.0f;
+
+static void EvolvePlane(const SpectrumData& data, float t, bool pack, std::vector<glm::vec2>& out) {
+    size_t stride = (size_t)size * size;
+    for (int n = 0; n < size; n++) {
+        glm::vec2* row = out.data() + n * size;
+        if (n == 0) {
+            EvolveSpectrumChannels(data, t, size, length, n, 1, row, stride, pack);
+            SetSpectrumTestBins(row, size, true);
+            DeriveSpectrumChannels(size, length, n, SPECTRUM_CHANNEL_COUNT, row, stride, pack);
+        } else {
+            EvolveSpectrumChannels(data, t, size, length, n, SPECTRUM_CHANNEL_COUNT, row, stride, pack);
+        }
+    }
+}
+
+int main() {
+    int bin_count = size * size;
+    auto mirror = [&](int bin) {
+        return ((size - bin / size) % size) * size + (size - bin % size) % size;
+    };
+
+    uint32_t state = 12345u;
+    auto random = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)(state >> 8) / (float)(1u << 24) - 0.5f;
+    };
+    std::vector<float> tables(bin_count * 5);
+    SpectrumData data;
+    data.h0_re = tables.data();
+    data.h0_im = data.h0_re + bin_count;
+    data.h0_conj_re = data.h0_im + bin_count;
+    data.h0_conj_im = data.h0_conj_re + bin_count;
+    data.omega = data.h0_conj_im + bin_count;
+    for (int bin = 0; bin < bin_count; bin++) {
+        data.h0_re[bin] = random();
+        data.h0_im[bin] = random();
+        int n = bin / size - size / 2, m = bin % size - size / 2;
+        data.omega[bin] = (float)(n * n + m * m);
+    }
+    for (int bin = 0; bin < bin_count; bin++) {
+        data.h0_conj_re[bin] = data.h0_re[mirror(bin)];
+        data.h0_conj_im[bin] = -data.h0_im[mirror(bin)];
+    }
+
+    int map_count = (SPECTRUM_CHANNEL_COUNT + 1) / 2;
+    std::vector<glm::vec2> separate(bin_count * SPECTRUM_CHANNEL_COUNT), packed(bin_count * map_count);
+    EvolvePlane(data, 1.7f, false, separate);
+    EvolvePlane(data, 1.7f, true, packed);
+
+    am_fft_plan_2d_t* plan = am_fft_plan_2d(AM_FFT_FORWARD, size, size);
+    std::vector<glm::vec2> separate_out(separate.size()), packed_out(packed.size());
+    for (int c = 0; c < SPECTRUM_CHANNEL_COUNT; c++) {
+        am_fft_2d(plan, (const am_fft_complex_t*)&separate[c * bin_count], (am_fft_complex_t*)&separate_out[c * bin_count]);
+    }
+    for (int i = 0; i < map_count; i++) {
+        am_fft_2d(plan, (const am_fft_complex_t*)&packed[i * bin_count], (am_fft_complex_t*)&packed_out[i * bin_count]);
+    }
+    am_fft_plan_2d_free(plan);
+
+    int failures = 0;
+    for (int c = 0; c < SPECTRUM_CHANNEL_COUNT; c++) {
+        float scale = 0.0f;
+        for (int i = 0; i < bin_count; i++) {
+            scale = glm::max(scale, glm::abs(separate_out[c * bin_count + i].x));
+        }
+        float tolerance = 1e-5f * glm::max(scale, 1.0f);
+        for (int i = 0; i < bin_count; i++) {
+            // a hermitian channel transforms to a real field, and its packed half carries the same values
+            glm::vec2 value = separate_out[c * bin_count + i];
+            glm::vec2 map = packed_out[(c / 2) * bin_count + i];
+            float packed_value = c % 2 ? map.y : map.x;
+            if (glm::abs(value.y) > tolerance || glm::abs(packed_value - value.x) > tolerance) {
+                printf("channel %d texel %d: separate (%g, %g), packed %g\n", c, i, value.x, value.y, packed_value);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    printf(failures ? "SpectrumPackTest failed\n" : "SpectrumPackTest passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+#include "SpectrumKernel.h"
+
+#include <cstdio>
+#include <vector>
+
+// Prunes a random hermitian spectrum, where every bin ties with its mirror, at a range of energy fractions
+// and checks that the kept spectrum is still hermitian.
+int main() {
+    const int size = 16;
+    int bin_count = size * size;
+    auto mirror = [&](int bin) {
+        return ((size - bin / size) % size) * size + (size - bin % size) % size;
+    };
+
+    std::vector<glm::vec2> spectrum(bin_count);
+    uint32_t state = 12345u;
+    auto random = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)(state >> 8) / (float)(1u << 24) - 0.5f;
+    };
+    for (int bin = 0; bin < bin_count; bin++) {
+        int other = mirror(bin);
+        if (other < bin) {
+            spectrum[bin] = glm::vec2(spectrum[other].x, -spectrum[other].y);
+        } else if (other == bin) {
+            spectrum[bin] = glm::vec2(random(), 0.0f);
+        } else {
+            spectrum[bin] = glm::vec2(random(), random());
+        }
+    }
+
+    std::vector<float> energy(bin_count);
+    double total_energy = 0.0;
+    for (int bin = 0; bin < bin_count; bin++) {
+        energy[bin] = glm::dot(spectrum[bin], spectrum[bin]);
+        total_energy += energy[bin];
+    }
+
+    int failures = 0;
+    for (int step = 1; step < 20; step++) {
+        double fraction = step / 20.0;
+        std::vector<int> kept(bin_count);
+        double kept_energy = 0.0;
+        int kept_count = SelectSpectrumBins(energy.data(), size, size, true, fraction * total_energy, kept.data(), &kept_energy);
+
+        std::vector<glm::vec2> pruned(bin_count, glm::vec2(0.0f));
+        for (int i = 0; i < kept_count; i++) {
+            pruned[kept[i]] = spectrum[kept[i]];
+        }
+        for (int bin = 0; bin < bin_count; bin++) {
+            glm::vec2 other = pruned[mirror(bin)];
+            if (pruned[bin] != glm::vec2(other.x, -other.y)) {
+                printf("fraction %.2f: bin %d kept without its mirror %d\n", fraction, bin, mirror(bin));
+                failures++;
+                break;
+            }
+        }
+        if (kept_energy < fraction * total_energy * (1.0 - 1e-6)) {
+            printf("fraction %.2f: kept %g of %g\n", fraction, kept_energy, fraction * total_energy);
+            failures++;
+        }
+    }
+
+    printf(failures ? "SpectrumPruneTest failed\n" : "SpectrumPruneTest passed\n");
+    return failures ? 1 : 0;
+}